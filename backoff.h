@@ -0,0 +1,94 @@
+/*
+ * Backoff after a failed CAS
+ *
+ * Wrap every CAS whose failure sends the caller back to search again in
+ * backoff_cas(). It counts the CAS in stats.h and, after a failure, spins
+ * for a while picked by the policy chosen at build time:
+ *
+ *  default             retry at once
+ *  -DBACKOFF_EXP       exponential with full jitter: a random wait below a
+ *                      window that doubles with every failure in a row, up
+ *                      to BACKOFF_MAX spins, and resets to BACKOFF_MIN
+ *                      on success
+ *  -DBACKOFF_ADAPTIVE  a random wait below BACKOFF_MAX scaled by the recent
+ *                      failure rate of the thread, a moving average
+ *
+ * The including file defines MAX_THREADS and tid() and includes stats.h
+ * first.
+ */
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#define BACKOFF_MIN     4
+#define BACKOFF_MAX     4096
+#define BACKOFF_ONE     65536
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#if defined(BACKOFF_EXP) || defined(BACKOFF_ADAPTIVE)
+
+typedef struct {
+    alignas(128) uint64_t       seed;
+    unsigned                    window;
+    int                         rate;
+} backoff_t;
+
+static backoff_t backoff_state[MAX_THREADS];
+
+static inline unsigned backoff_random(backoff_t *b, unsigned bound)
+{
+    if (!b->seed)
+        b->seed = 0x9E3779B97F4A7C15ULL * (tid() + 1);
+
+    b->seed ^= b->seed << 13;
+    b->seed ^= b->seed >> 7;
+    b->seed ^= b->seed << 17;
+    return b->seed % bound;
+}
+
+static inline bool backoff_cas(bool ok)
+{
+    backoff_t *b = &backoff_state[tid()];
+    unsigned spins = 0;
+
+    stat_cas(ok);
+
+#if defined(BACKOFF_EXP)
+    if (ok) {
+        b->window = BACKOFF_MIN;
+    } else {
+        if (b->window < BACKOFF_MIN)
+            b->window = BACKOFF_MIN;
+        spins = backoff_random(b, b->window);
+        if (b->window < BACKOFF_MAX)
+            b->window *= 2;
+    }
+#else
+    b->rate += ((ok ? 0 : BACKOFF_ONE) - b->rate) / 8;
+    if (!ok)
+        spins = backoff_random(b, (long) b->rate * BACKOFF_MAX / BACKOFF_ONE
+                                  + 1);
+#endif
+
+    while (spins--)
+        cpu_relax();
+    return ok;
+}
+
+#else
+
+static inline bool backoff_cas(bool ok)
+{
+    return stat_cas(ok);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,736 @@
+/*
+ * Benchmark driver shared by all list variants
+ *
+ * The variant is compiled in with -DLIST_IMPL='"listN.c"' (see the bench-%
+ * rule in the Makefile) and driven through list_new(), list_insert(),
+ * list_delete() and list_find(); its own test main() is left out. With
+ * -DBENCH_CONTAINS lookups go through the variant's list_contains() instead,
+ * with -DBENCH_SCAN they become scans of the -w keys from the lookup key on
+ * through the variant's list_iter_init() and list_iter_next().
+ * With -DBENCH_BATCH inserts and deletes are issued through
+ * list_insert_batch() and list_delete_batch() in batches of -b keys.
+ * With -DBENCH_MAP, for variants built with -DLIST_MAP, inserts become
+ * map_put(), which replaces the value of a present key, deletes map_remove()
+ * and lookups map_get().
+ *
+ *  ./bench-listN [-t threads[,threads...]] [-k key range]
+ *                [-m insert:delete:find] [-d seconds] [-b batch[,batch...]]
+ *                [-w scan width]
+ *
+ * Every thread count given to -t is run in a fresh child process, which
+ * prints one row of the scaling curve: throughput and per-op latency
+ * percentiles, sampled every LAT_SAMPLE operations. Batched operations are
+ * not sampled; their rows show the speedup over the first batch size given.
+ * Every row also shows the cache misses per operation, counted by a
+ * perf_event_open() counter over the measured interval ("-" where the kernel
+ * offers none), and the peak RSS of the child, which holds the prefilled list.
+ * Variants that keep stats.h counters (LIST_STATS) add the share of CASes
+ * that failed, the CASes per second, and the restarts, nodes visited and
+ * helping unlinks per operation; list5 built with -DLIST_ELIM also the share
+ * of inserts and deletes that elim.h paired off.
+ *
+ * With -p compact or -p scatter every thread is pinned to one CPU of the
+ * NUMA topology in /sys/devices/system/node, or the one given to -T as a
+ * cpulist per node ("0-7,16-23:8-15,24-31"). Compact fills one node's CPUs
+ * before the next, scatter deals threads round-robin over the nodes; the
+ * nodes column shows how many a row spans, so compact and scatter rows of
+ * the same thread count compare within a socket and across sockets. Threads
+ * allocate their nodes after they are pinned, so the kernel places those
+ * pages on their own NUMA node; the prefill is done on the first CPU.
+ *
+ * Variants on a lock.h lock (list1, list4, built with -DLOCK_TTAS,
+ * -DLOCK_TICKET, -DLOCK_MCS or -DLOCK_CLH) add how fairly the lock shared out
+ * the operations, as Jain's index of the per-thread op counts (1 when all
+ * threads did as many, 1/threads when one did them all) and the fewest over
+ * the most ops of a thread, and the p50, p99 and p99.9 time the sampled
+ * operations waited to acquire the lock.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <limits.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define LIST_BENCH
+static void bench_lock_wait(uint64_t ns);
+#define LOCK_WAIT(ns)   bench_lock_wait(ns)
+#include LIST_IMPL
+
+#define DEF_THREADS     "1"
+#define DEF_KEY_RANGE   1024
+#define DEF_DURATION    2.0
+#define DEF_BATCH       "1"
+#define DEF_SCAN_WIDTH  64
+#define MAX_BATCH       4096
+
+#define MAX_NODES       64
+
+#define LAT_SAMPLE      8
+#define LAT_SUB_BITS    3
+#define LAT_BUCKETS     (64 << LAT_SUB_BITS)
+
+enum { OP_INSERT, OP_DELETE, OP_FIND, OP_MAX };
+
+enum { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+static const char *pin_names[] = { "none", "compact", "scatter" };
+
+typedef struct {
+    alignas(128) unsigned long  ops[OP_MAX];
+    unsigned long               lat[LAT_BUCKETS];
+    unsigned long               scanned;
+#ifdef LOCK_H
+    unsigned long               lock_lat[LAT_BUCKETS];
+#endif
+} bench_thread_t;
+
+static struct {
+    uintptr_t           key_range;
+    unsigned            mix[OP_MAX];
+    double              duration;
+    size_t              batch;
+    uintptr_t           scan_width;
+    int                 pin;
+} cfg = { DEF_KEY_RANGE, { 10, 10, 80 }, DEF_DURATION, 1, DEF_SCAN_WIDTH,
+          PIN_NONE };
+
+// The NUMA node of every usable CPU, -1 for the rest, and the pinning order
+static struct {
+    int                 n_nodes;
+    int                 node[CPU_SETSIZE];
+    int                 n_cpus;
+    int                 order[CPU_SETSIZE];
+} topo;
+
+static list_t *list;
+static bench_thread_t stats[MAX_THREADS];
+static thread_local bench_thread_t *self;
+static pthread_barrier_t start;
+static atomic_bool stop = ATOMIC_VAR_INIT(false);
+
+// Throughput of the last run, written by the child
+static double *result;
+static double baseline;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t xorshift64(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/*
+ * Log-linear histogram: the top bit of the value selects the power of two,
+ * the next LAT_SUB_BITS bits split it into equal sub-buckets.
+ */
+static inline size_t lat_bucket(uint64_t ns)
+{
+    if (ns < (1 << LAT_SUB_BITS))
+        return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1);
+    return ((size_t) (msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + sub;
+}
+
+static inline uint64_t lat_value(size_t bucket)
+{
+    if (bucket < (1 << LAT_SUB_BITS))
+        return bucket;
+    int msb = (bucket >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << LAT_SUB_BITS) - 1);
+    return (1ULL << msb) | (sub << (msb - LAT_SUB_BITS));
+}
+
+#ifdef LOCK_H
+
+// Called by lock_acquire() while lock_timed is set, only in bench threads
+static void bench_lock_wait(uint64_t ns)
+{
+    self->lock_lat[lat_bucket(ns)]++;
+}
+
+#endif
+
+/*
+ * Mark the CPUs of a cpulist ("0-3,8,10-11") that this process may run on
+ * as belonging to node
+ */
+static int topo_add(const char *list, int node, const cpu_set_t *allowed)
+{
+    const char *p = list;
+
+    while (*p && *p != '\n') {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+
+        if (end == p)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p)
+                return -1;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+            return -1;
+        for (long cpu = lo; cpu <= hi; cpu++)
+            if (CPU_ISSET(cpu, allowed) && topo.node[cpu] < 0)
+                topo.node[cpu] = node;
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n' && *p != ':')
+            return -1;
+        if (*p == ':')
+            break;
+    }
+    return 0;
+}
+
+/*
+ * Read the topology from sysfs, or from spec, cpulists separated by ':',
+ * and lay out the CPUs in the order threads are pinned to them
+ */
+static int topo_init(const char *spec)
+{
+    cpu_set_t allowed;
+    char path[64], line[4096];
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        topo.node[cpu] = -1;
+
+    topo.n_nodes = 0;
+    if (spec) {
+        for (const char *p = spec; p; p = strchr(p, ':')) {
+            if (*p == ':')
+                p++;
+            if (topo.n_nodes == MAX_NODES ||
+                topo_add(p, topo.n_nodes, &allowed))
+                return -1;
+            topo.n_nodes++;
+        }
+    } else {
+        for (int node = 0; node < MAX_NODES; node++) {
+            snprintf(path, sizeof(path),
+                     "/sys/devices/system/node/node%d/cpulist", node);
+            FILE *f = fopen(path, "r");
+            if (!f)
+                continue;
+            if (fgets(line, sizeof(line), f) &&
+                topo_add(line, topo.n_nodes, &allowed) == 0)
+                topo.n_nodes++;
+            fclose(f);
+        }
+        // No NUMA in sysfs: one node of every CPU we may use
+        if (!topo.n_nodes) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &allowed))
+                    topo.node[cpu] = 0;
+            topo.n_nodes = 1;
+        }
+    }
+
+    topo.n_cpus = 0;
+    if (cfg.pin == PIN_SCATTER) {
+        // The r-th CPU of every node, for r = 0, 1, ...
+        int rank[MAX_NODES] = { 0 };
+        for (bool more = true; more;) {
+            more = false;
+            for (int node = 0; node < topo.n_nodes; node++) {
+                int seen = 0;
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                    if (topo.node[cpu] != node || seen++ < rank[node])
+                        continue;
+                    topo.order[topo.n_cpus++] = cpu;
+                    rank[node]++;
+                    more = true;
+                    break;
+                }
+            }
+        }
+    } else {
+        for (int node = 0; node < topo.n_nodes; node++)
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (topo.node[cpu] == node)
+                    topo.order[topo.n_cpus++] = cpu;
+    }
+    return topo.n_cpus ? 0 : -1;
+}
+
+/*
+ * Pin the calling thread to the CPU of thread id
+ */
+static void topo_pin(size_t id)
+{
+    cpu_set_t set;
+
+    if (cfg.pin == PIN_NONE)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(topo.order[id % topo.n_cpus], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ * NUMA nodes the first n threads are pinned on
+ */
+static int topo_span(size_t n)
+{
+    bool used[MAX_NODES] = { false };
+    int span = 0;
+
+    for (size_t i = 0; i < n && i < (size_t) topo.n_cpus; i++) {
+        int node = topo.node[topo.order[i]];
+        span += !used[node];
+        used[node] = true;
+    }
+    return span;
+}
+
+/*
+ * Hardware cache misses of this process and every thread it creates from now
+ * on, mostly last-level misses on x86. Created disabled.
+ */
+static int perf_open(void)
+{
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(attr),
+        .config = PERF_COUNT_HW_CACHE_MISSES,
+        .disabled = 1,
+        .inherit = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#ifdef BENCH_MAP
+
+static inline bool bench_op(bench_thread_t *st, int op, uintptr_t key)
+{
+    switch (op) {
+    case OP_INSERT:
+        return map_put(list, key, key) == MAP_NONE;
+    case OP_DELETE:
+        return map_remove(list, key) != MAP_NONE;
+    default:
+        return map_get(list, key) != MAP_NONE;
+    }
+}
+
+#else
+
+static inline bool bench_op(bench_thread_t *st, int op, uintptr_t key)
+{
+    switch (op) {
+    case OP_INSERT:
+        return list_insert(list, key);
+#ifndef LIST_NO_DELETE
+    case OP_DELETE:
+        return list_delete(list, key);
+#endif
+    default:
+#if defined(BENCH_CONTAINS)
+        return list_contains(list, key);
+#elif defined(BENCH_SCAN)
+    {
+        list_iter_t it;
+        uintptr_t found;
+
+        list_iter_init(list, &it, key, key + cfg.scan_width);
+        while (list_iter_next(&it, &found))
+            st->scanned++;
+        return true;
+    }
+#else
+        return list_find(list, key);
+#endif
+    }
+}
+
+#endif
+
+static void *bench_thread(void *arg)
+{
+    size_t id = (uintptr_t) arg;
+    bench_thread_t *st = &stats[id];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (id + 1);
+    unsigned long n = 0;
+
+    self = st;
+    topo_pin(id);
+    pthread_barrier_wait(&start);
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        uint64_t r = xorshift64(&seed);
+        uintptr_t key = (r >> 8) % cfg.key_range + 1;
+        unsigned pick = r % 100;
+        int op = OP_INSERT;
+
+        while (pick >= cfg.mix[op]) {
+            pick -= cfg.mix[op];
+            op++;
+        }
+
+#ifdef BENCH_BATCH
+        if (cfg.batch > 1 && op != OP_FIND) {
+            uintptr_t keys[MAX_BATCH];
+
+            keys[0] = key;
+            for (size_t i = 1; i < cfg.batch; i++)
+                keys[i] = (xorshift64(&seed) >> 8) % cfg.key_range + 1;
+
+            if (op == OP_INSERT)
+                list_insert_batch(list, keys, cfg.batch);
+            else
+                list_delete_batch(list, keys, cfg.batch);
+            st->ops[op] += cfg.batch;
+            continue;
+        }
+#endif
+
+        if (++n % LAT_SAMPLE) {
+            bench_op(st, op, key);
+        } else {
+            uint64_t t0 = now_ns();
+#ifdef LOCK_H
+            lock_timed = true;
+            bench_op(st, op, key);
+            lock_timed = false;
+#else
+            bench_op(st, op, key);
+#endif
+            st->lat[lat_bucket(now_ns() - t0)]++;
+        }
+        st->ops[op]++;
+    }
+    return NULL;
+}
+
+static uint64_t percentile(const unsigned long *lat, unsigned long total,
+                           double p)
+{
+    unsigned long want = total * p, seen = 0;
+
+    for (size_t i = 0; i < LAT_BUCKETS; i++) {
+        seen += lat[i];
+        if (seen > want)
+            return lat_value(i);
+    }
+    return 0;
+}
+
+static int bench_run(size_t n_threads)
+{
+    pthread_t thr[MAX_THREADS];
+
+    topo_pin(0);
+    list = list_new();
+
+    /*
+     * Prefill every other key, the steady-state size of a balanced
+     * insert/delete mix. Descending order keeps it linear for the lists.
+     */
+    for (uintptr_t key = cfg.key_range & ~(uintptr_t) 1; key; key -= 2)
+#ifdef BENCH_MAP
+        map_put(list, key, key);
+#else
+        list_insert(list, key);
+#endif
+
+#ifdef LIST_STATS
+    list_stat_t prefill;
+    list_stats(&prefill);
+#endif
+    int perf_fd = perf_open();
+
+    pthread_barrier_init(&start, NULL, n_threads + 1);
+    for (size_t i = 0; i < n_threads; i++)
+        pthread_create(&thr[i], NULL, bench_thread, (void *) i);
+
+    pthread_barrier_wait(&start);
+    if (perf_fd >= 0)
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    uint64_t t0 = now_ns();
+    struct timespec d = {
+        .tv_sec = (time_t) cfg.duration,
+        .tv_nsec = (long) ((cfg.duration - (time_t) cfg.duration) * 1e9),
+    };
+    nanosleep(&d, NULL);
+    atomic_store(&stop, true);
+
+    for (size_t i = 0; i < n_threads; i++)
+        pthread_join(thr[i], NULL);
+    double elapsed = (now_ns() - t0) / 1e9;
+
+    uint64_t misses = 0;
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+            perf_fd = -1;
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    unsigned long ops = 0, samples = 0, scans = 0, scanned = 0;
+    unsigned long lat[LAT_BUCKETS] = { 0 };
+    for (size_t i = 0; i < n_threads; i++) {
+        scans += stats[i].ops[OP_FIND];
+        scanned += stats[i].scanned;
+        for (int op = 0; op < OP_MAX; op++)
+            ops += stats[i].ops[op];
+        for (size_t b = 0; b < LAT_BUCKETS; b++) {
+            lat[b] += stats[i].lat[b];
+            samples += stats[i].lat[b];
+        }
+    }
+
+    *result = ops / elapsed;
+
+    printf("%7zu %14.0f %10.1f %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+           " %8" PRIu64, n_threads, ops / elapsed,
+           elapsed * 1e9 * n_threads / ops,
+           percentile(lat, samples, 0.50), percentile(lat, samples, 0.90),
+           percentile(lat, samples, 0.99), percentile(lat, samples, 0.999));
+    if (perf_fd >= 0)
+        printf(" %8.2f", (double) misses / ops);
+    else
+        printf(" %8s", "-");
+    printf(" %8ld", ru.ru_maxrss);
+    if (cfg.pin != PIN_NONE)
+        printf(" %5d", topo_span(n_threads));
+    else
+        printf(" %5s", "-");
+#ifdef LIST_STATS
+    list_stat_t st;
+    list_stats(&st);
+    unsigned long cas = st.cas - prefill.cas;
+    printf(" %8.2f %10.0f %8.4f %8.1f %8.4f",
+           cas ? 100.0 * (st.cas_failed - prefill.cas_failed) / cas : 0.0,
+           cas / elapsed,
+           (double) (st.restarts - prefill.restarts) / ops,
+           (double) (st.visits - prefill.visits) / ops,
+           (double) (st.unlinks - prefill.unlinks) / ops);
+#ifdef ELIM_H
+    unsigned long updates = 0;
+    for (size_t i = 0; i < n_threads; i++)
+        updates += stats[i].ops[OP_INSERT] + stats[i].ops[OP_DELETE];
+    printf(" %6.2f", updates ?
+           100.0 * (st.eliminated - prefill.eliminated) / updates : 0.0);
+#endif
+#endif
+#ifdef LOCK_H
+    // Per-thread ops for the fairness, merged lock waits for their tail
+    unsigned long lock_lat[LAT_BUCKETS] = { 0 }, waits = 0;
+    unsigned long least = ULONG_MAX, most = 0;
+    double sum = 0, sum_sq = 0;
+    for (size_t i = 0; i < n_threads; i++) {
+        unsigned long mine = 0;
+        for (int op = 0; op < OP_MAX; op++)
+            mine += stats[i].ops[op];
+        sum += mine;
+        sum_sq += (double) mine * mine;
+        least = mine < least ? mine : least;
+        most = mine > most ? mine : most;
+        for (size_t b = 0; b < LAT_BUCKETS; b++) {
+            lock_lat[b] += stats[i].lock_lat[b];
+            waits += stats[i].lock_lat[b];
+        }
+    }
+    printf(" %6.3f %7.3f %8" PRIu64 " %8" PRIu64 " %8" PRIu64,
+           sum_sq ? sum * sum / (n_threads * sum_sq) : 1.0,
+           most ? (double) least / most : 1.0,
+           percentile(lock_lat, waits, 0.50), percentile(lock_lat, waits, 0.99),
+           percentile(lock_lat, waits, 0.999));
+#endif
+#ifdef BENCH_SCAN
+    printf(" %12.0f %9.1f", scanned / elapsed,
+           scans ? (double) scanned / scans : 0.0);
+#endif
+#ifdef BENCH_BATCH
+    printf(" %6zu %8.2f", cfg.batch, baseline ? *result / baseline : 1.0);
+#endif
+    putchar('\n');
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t threads[,threads...]] [-k key range] "
+            "[-m insert:delete:find] [-d seconds] [-b batch[,batch...]] "
+            "[-w scan width] [-p none|compact|scatter] "
+            "[-T cpulist[:cpulist...]]\n", prog);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    char def_threads[] = DEF_THREADS, *threads = def_threads;
+    char def_batches[] = DEF_BATCH, *batches = def_batches;
+    const char *topology = NULL;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:k:m:d:b:w:p:T:h")) != -1) {
+        switch (c) {
+        case 't':
+            threads = optarg;
+            break;
+        case 'k':
+            cfg.key_range = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%u:%u:%u", &cfg.mix[OP_INSERT],
+                       &cfg.mix[OP_DELETE], &cfg.mix[OP_FIND]) != 3)
+                usage(argv[0]);
+            break;
+        case 'd':
+            cfg.duration = strtod(optarg, NULL);
+            break;
+        case 'b':
+            batches = optarg;
+            break;
+        case 'w':
+            cfg.scan_width = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            for (cfg.pin = PIN_SCATTER; cfg.pin >= 0; cfg.pin--)
+                if (!strcmp(optarg, pin_names[cfg.pin]))
+                    break;
+            if (cfg.pin < 0)
+                usage(argv[0]);
+            break;
+        case 'T':
+            topology = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (cfg.key_range < 1 || cfg.key_range >= UINTPTR_MAX - 1 ||
+        cfg.scan_width < 1 || cfg.scan_width > UINTPTR_MAX - cfg.key_range ||
+        cfg.duration <= 0 ||
+        cfg.mix[OP_INSERT] + cfg.mix[OP_DELETE] + cfg.mix[OP_FIND] != 100)
+        usage(argv[0]);
+#ifdef LIST_NO_DELETE
+    if (cfg.mix[OP_DELETE]) {
+        fprintf(stderr, "%s has no list_delete, use -m x:0:y\n", LIST_IMPL);
+        return -1;
+    }
+#endif
+
+    if (topo_init(topology)) {
+        fprintf(stderr, "no usable CPUs in the topology\n");
+        return -1;
+    }
+
+    printf("# %s keys %" PRIuPTR " mix %u:%u:%u %.1fs node %zuB\n", LIST_IMPL,
+           cfg.key_range, cfg.mix[OP_INSERT], cfg.mix[OP_DELETE],
+           cfg.mix[OP_FIND], cfg.duration, sizeof(list_node_t));
+    printf("# pin %s, %d CPUs on %d NUMA nodes\n", pin_names[cfg.pin],
+           topo.n_cpus, topo.n_nodes);
+#ifdef LOCK_H
+    printf("# lock %s\n", LOCK_NAME);
+#endif
+    printf("%7s %14s %10s %8s %8s %8s %8s %8s %8s %5s", "threads", "ops/s",
+           "ns/op", "p50", "p90", "p99", "p99.9", "miss/op", "rss KB", "nodes");
+#ifdef LIST_STATS
+    printf(" %8s %10s %8s %8s %8s", "casfail%", "cas/s", "rst/op", "visit/op",
+           "unl/op");
+#ifdef ELIM_H
+    printf(" %6s", "elim%");
+#endif
+#endif
+#ifdef LOCK_H
+    printf(" %6s %7s %8s %8s %8s", "jain", "min/max", "lock50", "lock99",
+           "lock99.9");
+#endif
+#ifdef BENCH_SCAN
+    printf(" %12s %9s", "scanned/s", "keys/scan");
+#endif
+#ifdef BENCH_BATCH
+    printf(" %6s %8s", "batch", "speedup");
+#endif
+    putchar('\n');
+    fflush(stdout);
+
+    result = mmap(NULL, sizeof(*result), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+        return -1;
+
+    char *save_t, *save_b;
+    for (char *tok = strtok_r(threads, ",", &save_t); tok;
+         tok = strtok_r(NULL, ",", &save_t)) {
+        size_t n = strtoul(tok, NULL, 0);
+
+        // The main thread takes one tid() while prefilling
+        if (n < 1 || n >= MAX_THREADS) {
+            fprintf(stderr, "thread count must be in [1, %d)\n", MAX_THREADS);
+            return -1;
+        }
+#ifdef LIST_SINGLE_THREADED
+        if (n > 1) {
+            fprintf(stderr, "%s is not thread-safe, use -t 1\n", LIST_IMPL);
+            return -1;
+        }
+#endif
+
+        char *list_b = strdup(batches);
+        baseline = 0;
+        for (char *b = strtok_r(list_b, ",", &save_b); b;
+             b = strtok_r(NULL, ",", &save_b)) {
+            int status;
+
+            cfg.batch = strtoul(b, NULL, 0);
+            if (cfg.batch < 1 || cfg.batch > MAX_BATCH) {
+                fprintf(stderr, "batch size must be in [1, %d]\n", MAX_BATCH);
+                return -1;
+            }
+#ifndef BENCH_BATCH
+            if (cfg.batch > 1) {
+                fprintf(stderr, "%s has no batch API\n", LIST_IMPL);
+                return -1;
+            }
+#endif
+
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0)
+                return bench_run(n);
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || status)
+                return -1;
+            if (!baseline)
+                baseline = *result;
+        }
+        free(list_b);
+    }
+    return 0;
+}
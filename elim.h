@@ -0,0 +1,141 @@
+/*
+ * Elimination array for insert and delete of the same key
+ *
+ * An insert(k) and a delete(k) that meet here both return true without
+ * touching the list. Whatever the list holds at the moment they meet, the
+ * pair is linearizable there back to back: delete then insert if k is in
+ * the list, insert then delete if not, and the list is the same after.
+ *
+ * Keys hash to one of ELIM_SLOTS slots. A slot points to the record of a
+ * thread waiting there with an offer; whoever finds an offer of the other
+ * kind for its key takes it with one CAS on the record's state, and the
+ * waiter takes it back with the same CAS once it gives up, so exactly one of
+ * them wins. States carry a sequence number, so a stale taker cannot hit a
+ * later offer of the same thread; the fences pair up as in a seqlock for
+ * the key read in between.
+ *
+ * How long a thread waits adapts as in a backoff: it doubles, up to
+ * ELIM_SPINS, when a partner came and halves when none did, down to
+ * ELIM_MIN; after a wait of ELIM_MIN in vain the thread skips its next
+ * ELIM_SKIP offers, so updates that never meet a partner seldom wait.
+ * With -DELIM_WAIT_YIELD a thread also yields once before it gives up, so
+ * with more threads than CPUs a partner gets to run during the wait.
+ *
+ * The including file defines MAX_THREADS and tid() and includes stats.h and
+ * backoff.h first.
+ */
+#ifndef ELIM_H
+#define ELIM_H
+
+#include <sched.h>
+
+#ifndef ELIM_SLOTS
+#define ELIM_SLOTS      16
+#endif
+#ifndef ELIM_SPINS
+#define ELIM_SPINS      256
+#endif
+#define ELIM_MIN        16
+#define ELIM_SKIP       64
+#define ELIM_YIELD      64
+
+enum { ELIM_IDLE, ELIM_INSERT, ELIM_DELETE, ELIM_TAKEN };
+
+#define elim_status(s)  ((s) & 3)
+
+typedef struct {
+    alignas(128) atomic_uintptr_t   state;  // sequence << 2 | status
+    atomic_uintptr_t                key;
+    int                             wait;   // spins, only the owner's
+} elim_rec_t;
+
+static elim_rec_t elim_recs[MAX_THREADS];
+static struct {
+    alignas(128) _Atomic(elim_rec_t *) rec;
+} elim_slots[ELIM_SLOTS];
+
+static inline _Atomic(elim_rec_t *) *elim_slot(uintptr_t key)
+{
+    return &elim_slots[(key * 0x9E3779B97F4A7C15ULL >> 32) % ELIM_SLOTS].rec;
+}
+
+/*
+ * Take the offer waiting in key's slot if it is op's counterpart on key
+ */
+static bool elim_take(int op, uintptr_t key)
+{
+    elim_rec_t *rec = atomic_load_explicit(elim_slot(key),
+                                           memory_order_acquire);
+    if (!rec)
+        return false;
+
+    uintptr_t s = atomic_load_explicit(&rec->state, memory_order_acquire);
+    if (elim_status(s) != (op == ELIM_INSERT ? ELIM_DELETE : ELIM_INSERT))
+        return false;
+    uintptr_t k = atomic_load_explicit(&rec->key, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (k != key ||
+        !atomic_compare_exchange_strong(&rec->state, &s,
+                                        (s & ~(uintptr_t) 3) | ELIM_TAKEN))
+        return false;
+
+    stat_inc(eliminated);
+    return true;
+}
+
+/*
+ * Wait in key's slot for a while for op's counterpart, true if it came
+ */
+static bool elim_offer(int op, uintptr_t key)
+{
+    _Atomic(elim_rec_t *) *slot = elim_slot(key);
+    elim_rec_t *me = &elim_recs[tid()], *empty = NULL;
+
+    if (me->wait < ELIM_MIN) {
+        me->wait++;
+        return false;
+    }
+    if (atomic_load_explicit(slot, memory_order_relaxed) ||
+        !atomic_compare_exchange_strong(slot, &empty, me))
+        return false;
+
+    // Takers still holding our last state fail from the fence on
+    uintptr_t s = ((atomic_load_explicit(&me->state, memory_order_relaxed)
+                    >> 2) + 1) << 2 | op;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&me->key, key, memory_order_relaxed);
+    atomic_store_explicit(&me->state, s, memory_order_release);
+
+    bool taken = false;
+    for (int spins = 1; spins <= me->wait; spins++) {
+        if (elim_status(atomic_load_explicit(&me->state,
+                                             memory_order_acquire)) ==
+            ELIM_TAKEN) {
+            taken = true;
+            break;
+        }
+#ifdef ELIM_WAIT_YIELD
+        if (spins % ELIM_YIELD == 0 || spins == me->wait)
+#else
+        if (spins % ELIM_YIELD == 0)
+#endif
+            sched_yield();
+        else
+            cpu_relax();
+    }
+    if (!taken)
+        taken = !atomic_compare_exchange_strong(&me->state, &s,
+                                                (s & ~(uintptr_t) 3) |
+                                                ELIM_IDLE);
+
+    atomic_store_explicit(slot, NULL, memory_order_release);
+    if (taken) {
+        stat_inc(eliminated);
+        me->wait = me->wait * 2 < ELIM_SPINS ? me->wait * 2 : ELIM_SPINS;
+    } else {
+        me->wait = me->wait > ELIM_MIN ? me->wait / 2 : ELIM_MIN - ELIM_SKIP;
+    }
+    return taken;
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <threads.h>
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+/*
+ * Chained hash set behind one mutex, doubling its bucket array whenever
+ * the average chain grows longer than LOAD_FACTOR.
+ */
+#define INITIAL_SIZE    2
+#define LOAD_FACTOR     4
+
+typedef struct list_node {
+    struct list_node    *next;
+    uintptr_t           key;
+} list_node_t;
+
+typedef struct {
+    list_node_t         **buckets;
+    size_t              size;
+    size_t              count;
+} hash_t;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t hash(uintptr_t key)
+{
+    uint64_t h = key;
+    h ^= h >> 31;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+static hash_t *hash_new() {
+    hash_t *set = malloc(sizeof(hash_t));
+
+    set->buckets = calloc(INITIAL_SIZE, sizeof(list_node_t *));
+    set->size = INITIAL_SIZE;
+    set->count = 0;
+
+    return set;
+}
+
+static list_node_t **__hash_find(hash_t *set, uintptr_t key)
+{
+    list_node_t **prev = &set->buckets[hash(key) & (set->size - 1)];
+
+    while (*prev && (*prev)->key != key)
+        prev = &(*prev)->next;
+
+    return prev;
+}
+
+static void __hash_grow(hash_t *set)
+{
+    size_t size = set->size * 2;
+    list_node_t **buckets = calloc(size, sizeof(list_node_t *));
+
+    for (size_t i = 0; i < set->size; i++) {
+        list_node_t *curr = set->buckets[i];
+        while (curr) {
+            list_node_t *next = curr->next;
+            list_node_t **head = &buckets[hash(curr->key) & (size - 1)];
+            curr->next = *head;
+            *head = curr;
+            curr = next;
+        }
+    }
+
+    free(set->buckets);
+    set->buckets = buckets;
+    set->size = size;
+}
+
+static bool hash_insert(hash_t *set, uintptr_t key)
+{
+    list_node_t *new = malloc(sizeof(list_node_t));
+    new->key = key;
+
+    pthread_mutex_lock(&mutex);
+    list_node_t **prev = __hash_find(set, key);
+    if (*prev) {
+        pthread_mutex_unlock(&mutex);
+        free(new);
+        return false;
+    }
+
+    new->next = NULL;
+    *prev = new;
+    if (++set->count > set->size * LOAD_FACTOR)
+        __hash_grow(set);
+    pthread_mutex_unlock(&mutex);
+
+    return true;
+}
+
+static bool hash_delete(hash_t *set, uintptr_t key)
+{
+    pthread_mutex_lock(&mutex);
+    list_node_t **prev = __hash_find(set, key);
+    list_node_t *curr = *prev;
+    if (!curr) {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    *prev = curr->next;
+    set->count--;
+    pthread_mutex_unlock(&mutex);
+
+    free(curr);
+    return true;
+}
+
+static bool hash_contains(hash_t *set, uintptr_t key)
+{
+    pthread_mutex_lock(&mutex);
+    bool found = *__hash_find(set, key) != NULL;
+    pthread_mutex_unlock(&mutex);
+    return found;
+}
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifdef LIST_BENCH
+
+typedef hash_t list_t;
+
+#define list_new        hash_new
+#define list_insert     hash_insert
+#define list_delete     hash_delete
+#define list_find       hash_contains
+
+#else
+
+#define N_ELEMENTS 4096
+#define N_THREADS 4
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    hash_t *set = arg;
+
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        hash_insert(set, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    hash_t *set = arg;
+
+    int deleted = 0;
+    for (int j = 0; j < 1000000; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i += 2)
+            deleted += hash_delete(set, (uintptr_t) &elements[tid()-1][i]);
+        if (deleted == N_ELEMENTS / 2) {
+            printf("\t\t break at %d\n", j);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    hash_t *set = hash_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, set);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    for (size_t tid = 0; tid < tid_v_base; tid += 2) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (hash_contains(set, (uintptr_t) &elements[tid][i]) != (i & 1)) {
+                fprintf(stderr, "KEY %lu %s!\n", (uintptr_t) &elements[tid][i],
+                        (i & 1) ? "NOT FOUND" : "FOUND AFTER DELETE");
+                return -1;
+            }
+        }
+    }
+
+    if (set->count != (N_THREADS >> 1) * (N_ELEMENTS / 2)) {
+        fprintf(stderr, "EXPECTED %d KEYS, SET SAYS %zu\n",
+                (N_THREADS >> 1) * (N_ELEMENTS / 2), set->count);
+        return -1;
+    }
+
+    printf("%zu keys in %zu buckets\n", set->count, set->size);
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,390 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <threads.h>
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+#define is_marked(p)            (bool) ((uintptr_t)(p) &0x01)
+#define get_marked(p)           ((uintptr_t)(p) | (0x01))
+#define get_marked_node(p)      ((list_node_t *) get_marked(p))
+#define get_unmarked(p)         ((uintptr_t)(p) & (~0x01))
+#define get_unmarked_node(p)    ((list_node_t *) get_unmarked(p))
+
+/*
+ * Split-ordered hash set (Shalev & Shavit)
+ *
+ * All keys live in one list5 list, sorted by their bit-reversed hash, so that
+ * the keys of bucket b are a contiguous run that starts with a dummy node for
+ * b. Doubling the number of buckets splits every run in two without moving a
+ * node: a new bucket is initialized lazily by inserting its dummy node after
+ * the one of its parent bucket, the bucket with the top bit of b cleared.
+ * Regular keys have the lowest bit of their split-order key set, dummy nodes
+ * have it cleared. Keys must be below 2^63.
+ */
+#define SEGMENT_SIZE    1024
+#define MAX_SEGMENTS    4096
+#define LOAD_FACTOR     4
+
+#define KEY_MASK        (UINT64_MAX >> 1)
+
+typedef struct {
+    atomic_uintptr_t    next;
+    uintptr_t           key;
+} list_node_t;
+
+typedef struct {
+    atomic_uintptr_t    segments[MAX_SEGMENTS];
+    atomic_size_t       size;
+    atomic_size_t       count;
+} hash_t;
+
+static inline uint64_t reverse(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+/*
+ * Bijective on [0, 2^63), so distinct keys never share a split-order key
+ */
+static inline uint64_t hash(uintptr_t key)
+{
+    uint64_t h = key & KEY_MASK;
+    h ^= h >> 31;
+    h = (h * 0x9E3779B97F4A7C15ULL) & KEY_MASK;
+    h ^= h >> 29;
+    return h;
+}
+
+static inline uintptr_t so_regular_key(uint64_t h)
+{
+    return reverse(h | ~KEY_MASK);
+}
+
+static inline uintptr_t so_dummy_key(size_t bucket)
+{
+    return reverse(bucket);
+}
+
+static atomic_uintptr_t *bucket_slot(hash_t *set, size_t bucket)
+{
+    atomic_uintptr_t *segment;
+
+    segment = (atomic_uintptr_t *)
+              atomic_load(&set->segments[bucket / SEGMENT_SIZE]);
+    if (!segment) {
+        uintptr_t tmp = 0;
+        atomic_uintptr_t *new = calloc(SEGMENT_SIZE, sizeof(*new));
+        if (atomic_compare_exchange_strong(&set->segments[bucket / SEGMENT_SIZE],
+                                           &tmp, (uintptr_t) new)) {
+            segment = new;
+        } else {
+            free(new);
+            segment = (atomic_uintptr_t *) tmp;
+        }
+    }
+    return &segment[bucket % SEGMENT_SIZE];
+}
+
+/*
+ * list5's __list_find, starting from a bucket instead of the list head.
+ * The list ends in NULL rather than a tail sentinel, since every
+ * split-order key is taken.
+ */
+static bool __list_find(atomic_uintptr_t *head,
+                        uintptr_t *key,
+                        atomic_uintptr_t **par_prev,
+                        list_node_t **par_curr,
+                        list_node_t **par_next)
+{
+    atomic_uintptr_t *prev = NULL;
+    list_node_t *curr = NULL, *next = NULL;
+
+try_again:
+    prev = head;
+    curr = (list_node_t *) atomic_load(prev);
+
+    if (atomic_load(prev) != get_unmarked(curr)) {
+        goto try_again;
+    }
+
+    while (true) {
+        if (!curr) {
+            *par_curr = curr;
+            *par_prev = prev;
+            *par_next = NULL;
+            return false;
+        }
+
+        next = (list_node_t *) atomic_load(&curr->next);
+
+        if (atomic_load(&curr->next) != (uintptr_t) next) {
+            goto try_again;
+        }
+        if (atomic_load(prev) != get_unmarked(curr)) {
+            goto try_again;
+        }
+
+        if (get_unmarked_node(next) == next) {
+            if (!(curr->key < *key)) {
+                *par_curr = curr;
+                *par_prev = prev;
+                *par_next = next;
+                return (curr->key == *key);
+            }
+            prev = &curr->next;
+
+        } else {
+            uintptr_t tmp = get_unmarked(curr);
+            if (!atomic_compare_exchange_strong(prev, &tmp,
+                                                get_unmarked(next))) {
+                goto try_again;
+            }
+            next = get_unmarked_node(next);
+        }
+        curr = next;
+    }
+}
+
+/*
+ * Insert node unless its key is present; returns the node holding the key.
+ */
+static list_node_t *__list_insert(atomic_uintptr_t *head, list_node_t *new)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    while (true) {
+        if (__list_find(head, &new->key, &prev, &curr, &next)) {
+            return curr;
+        }
+
+        atomic_store_explicit(&new->next, (uintptr_t) curr,
+                              memory_order_relaxed);
+        uintptr_t tmp = (uintptr_t) curr;
+        if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t) new)) {
+            return new;
+        }
+    }
+}
+
+static atomic_uintptr_t *bucket_get(hash_t *set, size_t bucket)
+{
+    atomic_uintptr_t *slot = bucket_slot(set, bucket);
+
+    if (atomic_load(slot))
+        return slot;
+
+    size_t parent = bucket & ~((size_t) 1 << (63 - __builtin_clzll(bucket)));
+    list_node_t *dummy = malloc(sizeof(list_node_t));
+    dummy->key = so_dummy_key(bucket);
+
+    list_node_t *node = __list_insert(bucket_get(set, parent), dummy);
+    if (node != dummy)
+        free(dummy);
+
+    uintptr_t tmp = 0;
+    atomic_compare_exchange_strong(slot, &tmp, (uintptr_t) node);
+    return slot;
+}
+
+static hash_t *hash_new() {
+    hash_t *set = calloc(1, sizeof(hash_t));
+    list_node_t *sentry_head = malloc(sizeof(list_node_t));
+
+    atomic_init(&sentry_head->next, 0);
+    sentry_head->key = so_dummy_key(0);
+
+    atomic_init(bucket_slot(set, 0), (uintptr_t) sentry_head);
+    atomic_init(&set->size, 2);
+    atomic_init(&set->count, 0);
+
+    return set;
+}
+
+static atomic_uintptr_t *hash_bucket(hash_t *set, uint64_t h)
+{
+    return bucket_get(set, h & (atomic_load(&set->size) - 1));
+}
+
+static bool hash_insert(hash_t *set, uintptr_t key)
+{
+    uint64_t h = hash(key);
+    list_node_t *new = malloc(sizeof(list_node_t));
+    new->key = so_regular_key(h);
+
+    if (__list_insert(hash_bucket(set, h), new) != new) {
+        free(new);
+        return false;
+    }
+
+    size_t size = atomic_load(&set->size);
+    if (atomic_fetch_add(&set->count, 1) + 1 > size * LOAD_FACTOR &&
+        size * 2 <= (size_t) SEGMENT_SIZE * MAX_SEGMENTS) {
+        atomic_compare_exchange_strong(&set->size, &size, size * 2);
+    }
+    return true;
+}
+
+static bool hash_delete(hash_t *set, uintptr_t key)
+{
+    uint64_t h = hash(key);
+    uintptr_t so_key = so_regular_key(h);
+    atomic_uintptr_t *head = hash_bucket(set, h);
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    while (true) {
+        if (!__list_find(head, &so_key, &prev, &curr, &next)) {
+            return false;
+        }
+
+        uintptr_t tmp = get_unmarked(next);
+
+        if (!atomic_compare_exchange_strong(&curr->next, &tmp,
+                                            get_marked(next))) {
+            continue;
+        }
+
+        tmp = get_unmarked(curr);
+
+        atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next));
+        atomic_fetch_sub(&set->count, 1);
+        return true;
+    }
+}
+
+/*
+ * list5's list_contains from the bucket's dummy node. Finding the bucket may
+ * first initialize it, which links its dummy node like any insert; past
+ * that the walk never writes and never restarts, so it is not held up by a
+ * concurrent resize either.
+ */
+static bool hash_contains(hash_t *set, uintptr_t key)
+{
+    uint64_t h = hash(key);
+    uintptr_t so_key = so_regular_key(h);
+    list_node_t *curr = (list_node_t *) atomic_load(hash_bucket(set, h));
+
+    while (curr && curr->key < so_key)
+        curr = get_unmarked_node(atomic_load(&curr->next));
+
+    return curr && curr->key == so_key && !is_marked(atomic_load(&curr->next));
+}
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifdef LIST_BENCH
+
+typedef hash_t list_t;
+
+#define list_new        hash_new
+#define list_insert     hash_insert
+#define list_delete     hash_delete
+#define list_find       hash_contains
+
+#else
+
+#define N_ELEMENTS 4096
+#define N_THREADS 4
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    hash_t *set = arg;
+
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        hash_insert(set, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    hash_t *set = arg;
+
+    int deleted = 0;
+    for (int j = 0; j < 1000000; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i += 2)
+            deleted += hash_delete(set, (uintptr_t) &elements[tid()-1][i]);
+        if (deleted == N_ELEMENTS / 2) {
+            printf("\t\t break at %d\n", j);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    hash_t *set = hash_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, set);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    for (size_t tid = 0; tid < tid_v_base; tid += 2) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (hash_contains(set, (uintptr_t) &elements[tid][i]) != (i & 1)) {
+                fprintf(stderr, "KEY %lu %s!\n", (uintptr_t) &elements[tid][i],
+                        (i & 1) ? "NOT FOUND" : "FOUND AFTER DELETE");
+                return -1;
+            }
+        }
+    }
+
+    size_t count = 0;
+    list_node_t *cur = (list_node_t *) atomic_load(bucket_slot(set, 0));
+    while (cur) {
+        list_node_t *next = (list_node_t *) atomic_load(&cur->next);
+        if (!is_marked(next) && (cur->key & 1))
+            count++;
+        next = get_unmarked_node(next);
+        if (next && !(cur->key < next->key)) {
+            fprintf(stderr, "UNEXPECTED ORDERING, %lu BEFORE %lu\n",
+                    cur->key, next->key);
+            return -1;
+        }
+        cur = next;
+    }
+    if (count != atomic_load(&set->count) ||
+        count != (N_THREADS >> 1) * (N_ELEMENTS / 2)) {
+        fprintf(stderr, "EXPECTED %d KEYS, COUNTED %zu, SET SAYS %zu\n",
+                (N_THREADS >> 1) * (N_ELEMENTS / 2), count,
+                atomic_load(&set->count));
+        return -1;
+    }
+
+    printf("%zu keys in %zu buckets\n", count, atomic_load(&set->size));
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
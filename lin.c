@@ -0,0 +1,429 @@
+/*
+ * Linearizability checker shared by all list variants
+ *
+ * Like bench.c, the variant is compiled in with -DLIST_IMPL='"listN.c"' (see
+ * the lin-% rule in the Makefile). Threads run a random insert:delete:find
+ * mix on a small key range, so that operations on a key overlap often, and
+ * record each operation with its invoke and response time into a buffer of
+ * their own; nothing is shared while they run but the list.
+ *
+ * The history is checked after the run. A set is P-compositional: a history
+ * is linearizable iff the subhistory of every key is. Each subhistory is
+ * checked with Wing & Gong's search as improved by Lowe, which remembers
+ * every (linearized operations, key present) state it has been in. The
+ * linearized operations are remembered by a Zobrist hash, so a collision
+ * could in theory hide a valid linearization, never invent one.
+ *
+ *  ./lin-listN [-t threads] [-k key range] [-n ops per thread]
+ *              [-m insert:delete:find] [-w file]
+ *  ./lin-listN -c file
+ *
+ * -w writes the history to a file, -c checks one written before.
+ */
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LIST_BENCH
+#include LIST_IMPL
+
+#define DEF_THREADS     4
+#define DEF_KEY_RANGE   8
+#define DEF_OPS         100000
+
+#define LIN_PRESENT     0xD6E8FEB86659FD93ULL
+
+typedef struct {
+    uint64_t            inv, resp;
+    uintptr_t           key;
+    char                kind;       // 'i', 'd' or 'f'
+    bool                result;
+} lin_op_t;
+
+typedef struct {
+    alignas(128) lin_op_t   *ops;
+    size_t                  n;
+} lin_log_t;
+
+static struct {
+    size_t              threads;
+    uintptr_t           key_range;
+    size_t              ops;
+    unsigned            mix[3];
+} cfg = { DEF_THREADS, DEF_KEY_RANGE, DEF_OPS, { 30, 30, 40 } };
+
+static list_t *list;
+static lin_log_t logs[MAX_THREADS];
+static pthread_barrier_t start;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t xorshift64(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void *lin_thread(void *arg)
+{
+    size_t id = (uintptr_t) arg;
+    lin_log_t *log = &logs[id];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (id + 1);
+
+    pthread_barrier_wait(&start);
+    for (size_t i = 0; i < cfg.ops; i++) {
+        uint64_t r = xorshift64(&seed);
+        lin_op_t *op = &log->ops[log->n++];
+        unsigned pick = r % 100;
+
+        op->key = (r >> 8) % cfg.key_range + 1;
+        op->inv = now_ns();
+        if (pick < cfg.mix[0]) {
+            op->kind = 'i';
+            op->result = list_insert(list, op->key);
+#ifndef LIST_NO_DELETE
+        } else if (pick < cfg.mix[0] + cfg.mix[1]) {
+            op->kind = 'd';
+            op->result = list_delete(list, op->key);
+#endif
+        } else {
+            op->kind = 'f';
+            op->result = list_find(list, op->key);
+        }
+        op->resp = now_ns();
+    }
+    return NULL;
+}
+
+/*
+ * A call or a return; at equal times calls sort first, so that operations
+ * are only ordered when one returned strictly before the other was invoked
+ */
+typedef struct {
+    uint64_t            time;
+    bool                ret;
+    size_t              op;
+    size_t              match;      // entry of the call's return
+    size_t              prev, next;
+} lin_entry_t;
+
+typedef struct {
+    uint64_t            *slot;
+    size_t              size, used;
+} lin_cache_t;
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const lin_entry_t *x = a, *y = b;
+    if (x->time != y->time)
+        return (x->time > y->time) - (x->time < y->time);
+    return x->ret - y->ret;
+}
+
+// Open addressing, 0 is the empty slot; returns whether h was new
+static bool cache_add(lin_cache_t *c, uint64_t h)
+{
+    if (!h)
+        h = 1;
+    if (2 * (c->used + 1) > c->size) {
+        lin_cache_t big = { calloc(c->size * 2, sizeof(uint64_t)),
+                            c->size * 2, 0 };
+        for (size_t i = 0; i < c->size; i++)
+            if (c->slot[i])
+                cache_add(&big, c->slot[i]);
+        free(c->slot);
+        *c = big;
+    }
+
+    size_t i = h & (c->size - 1);
+    while (c->slot[i]) {
+        if (c->slot[i] == h)
+            return false;
+        i = (i + 1) & (c->size - 1);
+    }
+    c->slot[i] = h;
+    c->used++;
+    return true;
+}
+
+/*
+ * Apply op to a key that is present or not; false if op cannot have
+ * returned what it did
+ */
+static bool lin_apply(const lin_op_t *op, bool *present)
+{
+    switch (op->kind) {
+    case 'i':
+        if (op->result == *present)
+            return false;
+        *present = true;
+        return true;
+    case 'd':
+        if (op->result != *present)
+            return false;
+        *present = false;
+        return true;
+    default:
+        return op->result == *present;
+    }
+}
+
+/*
+ * Wing, Gong & Lowe on the n operations of one key, which starts absent
+ */
+static bool lin_check_key(lin_op_t **ops, size_t n)
+{
+    lin_entry_t *e = malloc((2 * n + 1) * sizeof(*e));
+    uint64_t *zobrist = malloc(n * sizeof(uint64_t));
+    struct { size_t entry; bool present; } *stack = malloc(n * sizeof(*stack));
+    lin_cache_t cache = { calloc(1024, sizeof(uint64_t)), 1024, 0 };
+    uint64_t seed = 0x2545F4914F6CDD1DULL, lin = 0;
+    size_t top = 0;
+    bool present = false, ok = true;
+
+    for (size_t i = 0; i < n; i++) {
+        e[1 + 2 * i] = (lin_entry_t) { ops[i]->inv, false, i };
+        e[2 + 2 * i] = (lin_entry_t) { ops[i]->resp, true, i };
+        zobrist[i] = xorshift64(&seed);
+    }
+    qsort(e + 1, 2 * n, sizeof(*e), entry_cmp);
+
+    // e[0] is the head of a doubly linked list of entries, 0 ends it
+    size_t *ret_of = malloc(n * sizeof(size_t));
+    for (size_t i = 1; i <= 2 * n; i++) {
+        e[i].prev = i - 1;
+        e[i].next = i < 2 * n ? i + 1 : 0;
+        if (e[i].ret)
+            ret_of[e[i].op] = i;
+    }
+    e[0].next = n ? 1 : 0;
+    for (size_t i = 1; i <= 2 * n; i++)
+        if (!e[i].ret)
+            e[i].match = ret_of[e[i].op];
+    free(ret_of);
+
+    size_t cur = e[0].next;
+    while (e[0].next) {
+        if (!e[cur].ret) {
+            bool next = present;
+            uint64_t h = lin ^ zobrist[e[cur].op];
+            if (lin_apply(ops[e[cur].op], &next) &&
+                cache_add(&cache, h ^ (next ? LIN_PRESENT : 0))) {
+                // Linearize the call here: lift it and its return out
+                stack[top].entry = cur;
+                stack[top++].present = present;
+                present = next;
+                lin = h;
+                size_t r = e[cur].match;
+                e[e[cur].prev].next = e[cur].next;
+                e[e[cur].next].prev = e[cur].prev;
+                e[e[r].prev].next = e[r].next;
+                if (e[r].next)
+                    e[e[r].next].prev = e[r].prev;
+                cur = e[0].next;
+            } else {
+                cur = e[cur].next;
+            }
+        } else {
+            // A return before its call was linearized: undo the last one
+            if (!top) {
+                ok = false;
+                break;
+            }
+            cur = stack[--top].entry;
+            present = stack[top].present;
+            lin ^= zobrist[e[cur].op];
+            size_t r = e[cur].match;
+            e[e[r].prev].next = r;
+            if (e[r].next)
+                e[e[r].next].prev = r;
+            e[e[cur].prev].next = cur;
+            e[e[cur].next].prev = cur;
+            cur = e[cur].next;
+        }
+    }
+
+    free(cache.slot);
+    free(stack);
+    free(zobrist);
+    free(e);
+    return ok;
+}
+
+static int op_key_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (*(lin_op_t **) a)->key, y = (*(lin_op_t **) b)->key;
+    return (x > y) - (x < y);
+}
+
+static int lin_check(void)
+{
+    size_t total = 0, keys = 0;
+
+    for (size_t t = 0; t < MAX_THREADS; t++)
+        total += logs[t].n;
+
+    lin_op_t **ops = malloc(total * sizeof(*ops));
+    total = 0;
+    for (size_t t = 0; t < MAX_THREADS; t++)
+        for (size_t i = 0; i < logs[t].n; i++)
+            ops[total++] = &logs[t].ops[i];
+    qsort(ops, total, sizeof(*ops), op_key_cmp);
+
+    for (size_t i = 0, n; i < total; i += n, keys++) {
+        for (n = 1; i + n < total && ops[i + n]->key == ops[i]->key; n++)
+            ;
+        if (!lin_check_key(&ops[i], n)) {
+            fprintf(stderr, "KEY %" PRIuPTR ": %zu OPERATIONS NOT "
+                    "LINEARIZABLE!\n", ops[i]->key, n);
+            free(ops);
+            return -1;
+        }
+    }
+    free(ops);
+
+    printf("%zu operations on %zu keys linearizable\n", total, keys);
+    return 0;
+}
+
+static int lin_write(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    for (size_t t = 0; t < MAX_THREADS; t++)
+        for (size_t i = 0; i < logs[t].n; i++) {
+            lin_op_t *op = &logs[t].ops[i];
+            fprintf(f, "%zu %c %" PRIuPTR " %d %" PRIu64 " %" PRIu64 "\n", t,
+                    op->kind, op->key, op->result, op->inv, op->resp);
+        }
+    return fclose(f);
+}
+
+static int lin_read(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    lin_op_t op;
+    size_t cap[MAX_THREADS] = { 0 }, t;
+    int result;
+
+    if (!f)
+        return -1;
+    while (fscanf(f, "%zu %c %" SCNuPTR " %d %" SCNu64 " %" SCNu64, &t,
+                  &op.kind, &op.key, &result, &op.inv, &op.resp) == 6) {
+        if (t >= MAX_THREADS || !op.key || !strchr("idf", op.kind)) {
+            fclose(f);
+            return -1;
+        }
+        op.result = result;
+        if (logs[t].n == cap[t]) {
+            cap[t] = cap[t] ? 2 * cap[t] : 1024;
+            logs[t].ops = realloc(logs[t].ops, cap[t] * sizeof(op));
+        }
+        logs[t].ops[logs[t].n++] = op;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-k key range] [-n ops per thread] "
+            "[-m insert:delete:find] [-w file]\n       %s -c file\n",
+            prog, prog);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out = NULL, *in = NULL;
+    pthread_t thr[MAX_THREADS];
+    int c;
+
+    while ((c = getopt(argc, argv, "t:k:n:m:w:c:h")) != -1) {
+        switch (c) {
+        case 't':
+            cfg.threads = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            cfg.key_range = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            cfg.ops = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%u:%u:%u", &cfg.mix[0], &cfg.mix[1],
+                       &cfg.mix[2]) != 3)
+                usage(argv[0]);
+            break;
+        case 'w':
+            out = optarg;
+            break;
+        case 'c':
+            in = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (in) {
+        if (lin_read(in)) {
+            fprintf(stderr, "cannot read history from %s\n", in);
+            return -1;
+        }
+        return lin_check();
+    }
+
+    // The main thread takes one tid() for list_new()
+    if (cfg.threads < 1 || cfg.threads >= MAX_THREADS || cfg.key_range < 1 ||
+        cfg.key_range >= UINTPTR_MAX - 1 ||
+        cfg.mix[0] + cfg.mix[1] + cfg.mix[2] != 100)
+        usage(argv[0]);
+#ifdef LIST_NO_DELETE
+    if (cfg.mix[1]) {
+        fprintf(stderr, "%s has no list_delete, use -m x:0:y\n", LIST_IMPL);
+        return -1;
+    }
+#endif
+#ifdef LIST_SINGLE_THREADED
+    if (cfg.threads > 1) {
+        fprintf(stderr, "%s is not thread-safe, use -t 1\n", LIST_IMPL);
+        return -1;
+    }
+#endif
+
+    list = list_new();
+    for (size_t i = 0; i < cfg.threads; i++)
+        logs[i].ops = malloc(cfg.ops * sizeof(lin_op_t));
+
+    pthread_barrier_init(&start, NULL, cfg.threads);
+    for (size_t i = 0; i < cfg.threads; i++)
+        pthread_create(&thr[i], NULL, lin_thread, (void *) i);
+    for (size_t i = 0; i < cfg.threads; i++)
+        pthread_join(thr[i], NULL);
+
+    printf("# %s threads %zu keys %" PRIuPTR " mix %u:%u:%u\n", LIST_IMPL,
+           cfg.threads, cfg.key_range, cfg.mix[0], cfg.mix[1], cfg.mix[2]);
+    if (out && lin_write(out)) {
+        fprintf(stderr, "cannot write history to %s\n", out);
+        return -1;
+    }
+    return lin_check();
+}
@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -19,7 +20,19 @@ typedef struct {
     list_node_t     *tail;
 } list_t;
 
-static pthread_mutex_t mutex;
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#include "lock.h"
+
+static lock_t lock;
 
 static list_t *list_new() {
     list_t *list = malloc(sizeof(list_t));
@@ -31,6 +44,7 @@ static list_t *list_new() {
 
     list->head = sentry_head;
     list->tail = sentry_tail;
+    lock_init(&lock);
 
     return list;
 }
@@ -75,29 +89,33 @@ static bool list_insert(list_t *list, uintptr_t key)
     list_node_t *new = malloc(sizeof(list_node_t));
     new->key = key;
 
-    pthread_mutex_lock(&mutex);
+    lock_acquire(&lock);
     list_node_t **prev, *curr, *next;
     if (__list_find(list, &key, &prev, &curr, &next)) {
+        lock_release(&lock);
+        free(new);
         return false;
     }
 
     new->next = curr;
     *prev = new;
-    pthread_mutex_unlock(&mutex);
+    lock_release(&lock);
 
     return true;
 }
 
-static thread_local int tid_v = TID_UNKNOWN;
-static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
-static inline int tid(void)
+static bool list_find(list_t *list, uintptr_t key)
 {
-    if (tid_v == TID_UNKNOWN) {
-        tid_v = atomic_fetch_add(&tid_v_base, 1);
-    }
-    return tid_v;
+    list_node_t **prev, *curr, *next;
+
+    lock_acquire(&lock);
+    bool found = __list_find(list, &key, &prev, &curr, &next);
+    lock_release(&lock);
+    return found;
 }
 
+#ifndef LIST_BENCH
+
 #define N_ELEMENTS 128
 
 static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
@@ -116,7 +134,6 @@ static void *insert_thread(void *arg)
 
 int main() {
     pthread_t thr[N_THREADS];
-    pthread_mutex_init(&mutex, NULL);
 
     list_t *list = list_new();
 
@@ -128,7 +145,7 @@ int main() {
 
     list_node_t *cur = list->head;
 
-    for (size_t tid = 0; tid < tid_v_base; tid++) {
+    for (size_t tid = 0; tid < N_THREADS; tid++) {
         for (size_t i = 0; i < N_ELEMENTS; i++) {
             list_node_t *next = cur->next;
             if (!next) {
@@ -141,9 +158,15 @@ int main() {
                         (uintptr_t) &elements[tid][i], next->key);
                 return -1;
             }
+            if (!list_find(list, next->key)) {
+                fprintf(stderr, "KEY %lu NOT FOUND!\n", next->key);
+                return -1;
+            }
             cur = next;
         }
     }
     fprintf(stderr, "TEST OK!\n");
     return 0;
 }
+
+#endif
@@ -82,6 +82,7 @@ static bool list_insert(list_t *list, uintptr_t key)
 
     while (true) {
         if (__list_find(list, &key, &prev, &curr, &next)) {
+            free(new);
             return false;
         }
 
@@ -94,6 +95,13 @@ static bool list_insert(list_t *list, uintptr_t key)
     }
 }
 
+static bool list_find(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+    return __list_find(list, &key, &prev, &curr, &next);
+}
+
 static thread_local int tid_v = TID_UNKNOWN;
 static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
 static inline int tid(void)
@@ -104,6 +112,8 @@ static inline int tid(void)
     return tid_v;
 }
 
+#ifndef LIST_BENCH
+
 #define N_ELEMENTS 128
 
 static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
@@ -146,9 +156,15 @@ int main() {
                         (uintptr_t) &elements[tid][i], next->key);
                 return -1;
             }
+            if (!list_find(list, next->key)) {
+                fprintf(stderr, "KEY %lu NOT FOUND!\n", next->key);
+                return -1;
+            }
             cur = next;
         }
     }
     fprintf(stderr, "TEST OK!\n");
     return 0;
 }
+
+#endif
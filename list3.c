@@ -76,6 +76,7 @@ static bool list_insert(list_t *list, uintptr_t key)
 
     list_node_t **prev, *curr, *next;
     if (__list_find(list, &key, &prev, &curr, &next)) {
+        free(new);
         return false;
     }
 
@@ -97,6 +98,12 @@ static bool list_delete(list_t *list, uintptr_t key)
     return true;
 }
 
+static bool list_find(list_t *list, uintptr_t key)
+{
+    list_node_t **prev, *curr, *next;
+    return __list_find(list, &key, &prev, &curr, &next);
+}
+
 static thread_local int tid_v = TID_UNKNOWN;
 static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
 static inline int tid(void)
@@ -107,6 +114,8 @@ static inline int tid(void)
     return tid_v;
 }
 
+#ifndef LIST_BENCH
+
 #define N_ELEMENTS 128
 
 static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
@@ -137,6 +146,11 @@ int main() {
     for (size_t tid = 0; tid < tid_v_base; tid++) {
         for (size_t i = 0; i < N_ELEMENTS; i++) {
             list_delete(list, (uintptr_t) &elements[tid][i]);
+            if (list_find(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
         }
     }
 
@@ -158,3 +172,5 @@ int main() {
     fprintf(stderr, "TEST OK!\n");
     return 0;
 }
+
+#endif
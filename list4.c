@@ -1,10 +1,12 @@
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
 #include <threads.h>
 
 #define TID_UNKNOWN -1
@@ -13,6 +15,9 @@
 typedef struct {
     void            *next;
     uintptr_t       key;
+#ifdef LIST_MAP
+    uintptr_t       value;
+#endif
 } list_node_t;
 
 typedef struct {
@@ -20,7 +25,138 @@ typedef struct {
     list_node_t     *tail;
 } list_t;
 
-static pthread_mutex_t mutex;
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+/*
+ * Updates take write_lock() and lookups read_lock(), by default both the
+ * one lock.h lock, a mutex unless another is picked. Build with
+ *
+ *  -DLOCK_RWLOCK   a pthread rwlock, lookups share it
+ *  -DLOCK_BRLOCK   a big-reader lock: a rwlock per slot of threads, a lookup
+ *                  takes its own slot's and an update takes all of them
+ *  -DLOCK_RCU      lookups take no lock and updates the lock; delete frees
+ *                  a node only after a grace period, once every lookup that
+ *                  might still be on it has finished
+ *
+ * Under RCU links are published with release stores and followed with
+ * acquire loads, as lookups walk them while updates change them.
+ */
+#if defined(LOCK_RWLOCK)
+
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+#define read_lock()     pthread_rwlock_rdlock(&rwlock)
+#define read_unlock()   pthread_rwlock_unlock(&rwlock)
+#define write_lock()    pthread_rwlock_wrlock(&rwlock)
+#define write_unlock()  pthread_rwlock_unlock(&rwlock)
+#define locks_init()
+
+#elif defined(LOCK_BRLOCK)
+
+// Threads share slots by tid, like CPUs; TSan's deadlock detector crawls
+// once an update holds many more locks than this
+#ifndef BRLOCK_SLOTS
+#define BRLOCK_SLOTS    16
+#endif
+
+static struct {
+    alignas(128) pthread_rwlock_t lock;
+} brlock[BRLOCK_SLOTS];
+
+#define br_slot()       (tid() % BRLOCK_SLOTS)
+
+static void write_lock(void)
+{
+    for (int i = 0; i < BRLOCK_SLOTS; i++)
+        pthread_rwlock_wrlock(&brlock[i].lock);
+}
+
+static void write_unlock(void)
+{
+    for (int i = BRLOCK_SLOTS - 1; i >= 0; i--)
+        pthread_rwlock_unlock(&brlock[i].lock);
+}
+
+#define read_lock()     pthread_rwlock_rdlock(&brlock[br_slot()].lock)
+#define read_unlock()   pthread_rwlock_unlock(&brlock[br_slot()].lock)
+#define locks_init()
+
+#else
+
+#include "lock.h"
+
+static lock_t lock;
+
+#define write_lock()    lock_acquire(&lock)
+#define write_unlock()  lock_release(&lock)
+#define locks_init()    lock_init(&lock)
+
+#ifdef LOCK_RCU
+
+/*
+ * A lookup announces the grace period it started in, always odd, and clears
+ * it when done; a grace period ends once no lookup announces an earlier one
+ */
+static atomic_ulong rcu_gp = ATOMIC_VAR_INIT(1);
+
+// One more for the test's main thread, which looks up after MAX_THREADS others
+static struct {
+    alignas(128) atomic_ulong gp;
+} rcu_reader[MAX_THREADS + 1];
+
+static inline void read_lock(void)
+{
+    atomic_store(&rcu_reader[tid()].gp, atomic_load(&rcu_gp));
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void read_unlock(void)
+{
+    atomic_store_explicit(&rcu_reader[tid()].gp, 0, memory_order_release);
+}
+
+static void synchronize_rcu(void)
+{
+    // Order the unlink before reading the announcements, as a lookup orders
+    // its announcement before reading the links
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned long gp = atomic_fetch_add(&rcu_gp, 2) + 2;
+
+    for (int i = 0; i <= MAX_THREADS; i++) {
+        unsigned long reader;
+        while ((reader = atomic_load(&rcu_reader[i].gp)) &&
+               (long) (reader - gp) < 0)
+            sched_yield();
+    }
+}
+
+#define rcu_dereference(p)  __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_assign(p, v)    __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+#else
+
+#define read_lock()     write_lock()
+#define read_unlock()   write_unlock()
+
+#endif
+
+#endif
+
+#ifndef LOCK_RCU
+
+#define synchronize_rcu()
+#define rcu_dereference(p)  (p)
+#define rcu_assign(p, v)    ((p) = (v))
+
+#endif
 
 static list_t *list_new() {
     list_t *list = malloc(sizeof(list_t));
@@ -32,6 +168,7 @@ static list_t *list_new() {
 
     list->head = sentry_head;
     list->tail = sentry_tail;
+    locks_init();
 
     return list;
 }
@@ -47,7 +184,7 @@ static bool __list_find(list_t *list,
     list_node_t *next;
 
     while (true) {
-        next = curr->next;
+        next = rcu_dereference(curr->next);
 
         if (!(curr->key < *key)) {
             *par_curr = curr;
@@ -76,15 +213,17 @@ static bool list_insert(list_t *list, uintptr_t key)
     list_node_t *new = malloc(sizeof(list_node_t));
     new->key = key;
 
-    pthread_mutex_lock(&mutex);
+    write_lock();
     list_node_t **prev, *curr, *next;
     if (__list_find(list, &key, &prev, &curr, &next)) {
+        write_unlock();
+        free(new);
         return false;
     }
 
     new->next = curr;
-    *prev = new;
-    pthread_mutex_unlock(&mutex);
+    rcu_assign(*prev, new);
+    write_unlock();
 
     return true;
 }
@@ -93,30 +232,223 @@ static bool list_delete(list_t *list, uintptr_t key)
 {
     list_node_t **prev, *curr, *next;
 
-    pthread_mutex_lock(&mutex);
+    write_lock();
     if (!__list_find(list, &key, &prev, &curr, &next)) {
+        write_unlock();
         return false;
     }
 
-    *prev = next;
+    rcu_assign(*prev, next);
+    write_unlock();
+
+    synchronize_rcu();
     free(curr);
-    pthread_mutex_unlock(&mutex);
     return true;
 }
 
-static thread_local int tid_v = TID_UNKNOWN;
-static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
-static inline int tid(void)
+static int key_cmp(const void *a, const void *b)
 {
-    if (tid_v == TID_UNKNOWN) {
-        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sort keys in place and insert them in one forward pass under one lock
+ */
+static size_t list_insert_batch(list_t *list, uintptr_t *keys, size_t n)
+{
+    list_node_t *spare = NULL;
+    size_t inserted = 0;
+
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        list_node_t *new = malloc(sizeof(list_node_t));
+        new->next = spare;
+        spare = new;
     }
-    return tid_v;
+
+    write_lock();
+    list_node_t **prev = &list->head;
+    list_node_t *curr = *prev;
+
+    for (size_t i = 0; i < n; i++) {
+        while (curr->key < keys[i]) {
+            prev = (list_node_t **) &curr->next;
+            curr = curr->next;
+        }
+        if (curr->key == keys[i])
+            continue;
+
+        list_node_t *new = spare;
+        spare = spare->next;
+        new->key = keys[i];
+        new->next = curr;
+        rcu_assign(*prev, new);
+        // Becomes curr, so a repeated key finds it
+        curr = new;
+        inserted++;
+    }
+    write_unlock();
+
+    while (spare) {
+        list_node_t *next = spare->next;
+        free(spare);
+        spare = next;
+    }
+    return inserted;
 }
 
+/*
+ * Sort keys in place and delete them in one forward pass under one lock
+ */
+static size_t list_delete_batch(list_t *list, uintptr_t *keys, size_t n)
+{
+    // Not chained through next, a lookup may still be following it
+    list_node_t **removed = malloc(n * sizeof(*removed));
+    size_t count = 0;
+
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    write_lock();
+    list_node_t **prev = &list->head;
+    list_node_t *curr = *prev;
+
+    for (size_t i = 0; i < n; i++) {
+        while (curr->key < keys[i]) {
+            prev = (list_node_t **) &curr->next;
+            curr = curr->next;
+        }
+        if (curr->key != keys[i])
+            continue;
+
+        rcu_assign(*prev, curr->next);
+        removed[count++] = curr;
+        curr = *prev;
+    }
+    write_unlock();
+
+    if (count)
+        synchronize_rcu();
+    for (size_t i = 0; i < count; i++)
+        free(removed[i]);
+    free(removed);
+    return count;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    list_node_t **prev, *curr, *next;
+
+    read_lock();
+    bool found = __list_find(list, &key, &prev, &curr, &next);
+    read_unlock();
+    return found;
+}
+
+#ifdef LIST_MAP
+
+/*
+ * Key-value map on the list, built with -DLIST_MAP: the lock-based
+ * counterpart of list5's map. Values are any word but MAP_NONE, returned for
+ * absent keys, and MAP_DELETED, which list5 reserves.
+ */
+#define MAP_NONE        ((uintptr_t) 0)
+#define MAP_DELETED     UINTPTR_MAX
+
+typedef uintptr_t (*map_fn_t)(uintptr_t key, void *arg);
+
+/*
+ * Map key to value, returning the value it replaced or MAP_NONE
+ */
+static uintptr_t map_put(list_t *list, uintptr_t key, uintptr_t value)
+{
+    list_node_t **prev, *curr, *next;
+
+    write_lock();
+    if (__list_find(list, &key, &prev, &curr, &next)) {
+        uintptr_t old = curr->value;
+        rcu_assign(curr->value, value);
+        write_unlock();
+        return old;
+    }
+
+    list_node_t *new = malloc(sizeof(list_node_t));
+    new->key = key;
+    new->value = value;
+    new->next = curr;
+    rcu_assign(*prev, new);
+    write_unlock();
+    return MAP_NONE;
+}
+
+static uintptr_t map_get(list_t *list, uintptr_t key)
+{
+    list_node_t **prev, *curr, *next;
+    uintptr_t value = MAP_NONE;
+
+    read_lock();
+    if (__list_find(list, &key, &prev, &curr, &next))
+        value = rcu_dereference(curr->value);
+    read_unlock();
+    return value;
+}
+
+/*
+ * Remove key, returning its value or MAP_NONE
+ */
+static uintptr_t map_remove(list_t *list, uintptr_t key)
+{
+    list_node_t **prev, *curr, *next;
+
+    write_lock();
+    if (!__list_find(list, &key, &prev, &curr, &next)) {
+        write_unlock();
+        return MAP_NONE;
+    }
+
+    uintptr_t value = curr->value;
+    rcu_assign(*prev, next);
+    write_unlock();
+
+    synchronize_rcu();
+    free(curr);
+    return value;
+}
+
+/*
+ * The value of key, or, if it is absent, the value fn(key, arg) returns,
+ * which is added; fn runs under the lock
+ */
+static uintptr_t map_compute_if_absent(list_t *list, uintptr_t key,
+                                       map_fn_t fn, void *arg)
+{
+    list_node_t **prev, *curr, *next;
+
+    write_lock();
+    if (__list_find(list, &key, &prev, &curr, &next)) {
+        uintptr_t value = curr->value;
+        write_unlock();
+        return value;
+    }
+
+    list_node_t *new = malloc(sizeof(list_node_t));
+    new->key = key;
+    new->value = fn(key, arg);
+    new->next = curr;
+    rcu_assign(*prev, new);
+    write_unlock();
+    return new->value;
+}
+
+#endif
+
+#ifndef LIST_BENCH
+
 #define N_ELEMENTS 128
 
 static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+static atomic_bool broken;
 
 static void *insert_thread(void *arg)
 {
@@ -131,28 +463,133 @@ static void *insert_thread(void *arg)
 static void *delete_thread(void *arg)
 {
     list_t *list = arg;
-    // Slight changes to test ordering
-    for (int i = N_ELEMENTS - 1; i >= 0; i--)
-        list_delete(list, (uintptr_t) &elements[tid()-1][i]);
+
+    // Keys may not be inserted yet, retry until all of them are gone. Only
+    // this thread deletes them, so a key it finds must still be there.
+    int deleted = 0;
+    for (int j = 0; j < 1000000 && deleted < N_ELEMENTS; j++) {
+        for (int i = N_ELEMENTS - 1; i >= 0; i--) {
+            uintptr_t key = (uintptr_t) &elements[tid()-1][i];
+            if (!list_find(list, key))
+                continue;
+            if (!list_delete(list, key)) {
+                fprintf(stderr, "KEY %lu FOUND, BUT NOT DELETED!\n", key);
+                atomic_store(&broken, true);
+                return NULL;
+            }
+            deleted++;
+        }
+        sched_yield();
+    }
 
     return NULL;
 }
 
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
 #define N_THREADS 128
 
+#ifdef LIST_MAP
+
+static uintptr_t map_double(uintptr_t key, void *arg)
+{
+    (*(int *) arg)++;
+    return key * 2;
+}
+
+static int map_test(list_t *list)
+{
+    int calls = 0;
+
+    for (uintptr_t key = 1; key <= N_ELEMENTS; key++) {
+        if (map_put(list, key, key) != MAP_NONE ||
+            map_put(list, key, key + 1) != key ||
+            map_get(list, key) != key + 1 ||
+            map_compute_if_absent(list, key, map_double, &calls) != key + 1 ||
+            map_remove(list, key) != key + 1 ||
+            map_get(list, key) != MAP_NONE ||
+            map_remove(list, key) != MAP_NONE ||
+            map_compute_if_absent(list, key, map_double, &calls) != key * 2 ||
+            map_compute_if_absent(list, key, map_double, &calls) != key * 2 ||
+            map_remove(list, key) != key * 2) {
+            fprintf(stderr, "MAP: KEY %lu BROKEN!\n", key);
+            return -1;
+        }
+    }
+    if (calls != N_ELEMENTS) {
+        fprintf(stderr, "MAP: %d COMPUTE CALLS FOR %d KEYS!\n", calls,
+                N_ELEMENTS);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
+
 int main() {
     pthread_t thr[N_THREADS];
-    pthread_mutex_init(&mutex, NULL);
 
     list_t *list = list_new();
 
     for (size_t i = 0; i < N_THREADS; i++)
-        pthread_create(&thr[i], NULL, (i & 1) ? delete_thread : insert_thread,
-                       list);
+        pthread_create(&thr[i], NULL, test_thread, list);
 
     for (size_t i = 0; i < N_THREADS; i++)
         pthread_join(thr[i], NULL);
 
+    if (broken)
+        return -1;
+
+    // Reversed keys, so the batch calls have to sort them
+    uintptr_t batch[N_ELEMENTS];
+    for (size_t i = 0; i < N_ELEMENTS; i++)
+        batch[i] = (uintptr_t) &elements[0][N_ELEMENTS - 1 - i];
+
+    if (list_insert_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH INSERT FAILED!\n");
+        return -1;
+    }
+    for (size_t i = 0; i < N_ELEMENTS; i++) {
+        if (!list_find(list, batch[i])) {
+            fprintf(stderr, "KEY %lu NOT FOUND AFTER BATCH INSERT!\n",
+                    batch[i]);
+            return -1;
+        }
+    }
+    if (list_delete_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH DELETE FAILED!\n");
+        return -1;
+    }
+
+    // Repeated keys go in once
+    uintptr_t dup[] = { batch[0], batch[0], batch[0], batch[1] };
+    if (list_insert_batch(list, dup, 4) != 2) {
+        fprintf(stderr, "BATCH INSERT OF REPEATED KEYS FAILED!\n");
+        return -1;
+    }
+    if (!list_delete(list, dup[0]) || list_find(list, dup[0])) {
+        fprintf(stderr, "KEY %lu INSERTED MORE THAN ONCE!\n", dup[0]);
+        return -1;
+    }
+    if (!list_delete(list, dup[3])) {
+        fprintf(stderr, "KEY %lu NOT DELETED AFTER BATCH INSERT!\n", dup[3]);
+        return -1;
+    }
+
+    for (size_t tid = 0; tid < tid_v_base; tid++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
+        }
+    }
+
     list_node_t *cur = list->head;
     if (cur->key != 0) {
         fprintf(stderr, "EXPECTED HEAD, GOT %lu!\n", cur->key);
@@ -168,6 +605,13 @@ int main() {
         return -1;
     }
 
+#ifdef LIST_MAP
+    if (map_test(list))
+        return -1;
+#endif
+
     fprintf(stderr, "TEST OK!\n");
     return 0;
 }
+
+#endif
@@ -0,0 +1,213 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <threads.h>
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+/*
+ * Hand-over-hand locking: a thread holds the lock of a node until it has
+ * taken the lock of the next one, so no two threads ever overtake each other
+ * and a node may be freed as soon as it is unlinked.
+ */
+typedef struct {
+    atomic_uintptr_t    next;
+    uintptr_t           key;
+    pthread_mutex_t     lock;
+} list_node_t;
+
+typedef struct {
+    list_node_t         *head;
+    list_node_t         *tail;
+} list_t;
+
+static list_node_t *node_new(uintptr_t key)
+{
+    list_node_t *node = malloc(sizeof(list_node_t));
+    node->key = key;
+    pthread_mutex_init(&node->lock, NULL);
+    return node;
+}
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = node_new(0);
+    list_node_t *sentry_tail = node_new(UINTPTR_MAX);
+    atomic_init(&sentry_head->next, (uintptr_t) sentry_tail);
+    atomic_init(&sentry_tail->next, 0);
+
+    list->head = sentry_head;
+    list->tail = sentry_tail;
+
+    return list;
+}
+
+/*
+ * Returns with both prev and curr locked
+ */
+static bool __list_find(list_t *list,
+                        uintptr_t *key,
+                        list_node_t **par_prev,
+                        list_node_t **par_curr)
+{
+    list_node_t *prev = list->head;
+    pthread_mutex_lock(&prev->lock);
+    list_node_t *curr = (list_node_t *) atomic_load(&prev->next);
+    pthread_mutex_lock(&curr->lock);
+
+    while (curr->key < *key) {
+        pthread_mutex_unlock(&prev->lock);
+        prev = curr;
+        curr = (list_node_t *) atomic_load(&curr->next);
+        pthread_mutex_lock(&curr->lock);
+    }
+
+    *par_prev = prev;
+    *par_curr = curr;
+    return (curr->key == *key);
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *new = node_new(key);
+    list_node_t *prev, *curr;
+
+    if (__list_find(list, &key, &prev, &curr)) {
+        pthread_mutex_unlock(&curr->lock);
+        pthread_mutex_unlock(&prev->lock);
+        free(new);
+        return false;
+    }
+
+    atomic_store(&new->next, (uintptr_t) curr);
+    atomic_store(&prev->next, (uintptr_t) new);
+    pthread_mutex_unlock(&curr->lock);
+    pthread_mutex_unlock(&prev->lock);
+
+    return true;
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    list_node_t *prev, *curr;
+
+    if (!__list_find(list, &key, &prev, &curr)) {
+        pthread_mutex_unlock(&curr->lock);
+        pthread_mutex_unlock(&prev->lock);
+        return false;
+    }
+
+    // Anyone about to wait for curr would have to hold prev first
+    atomic_store(&prev->next, atomic_load(&curr->next));
+    pthread_mutex_unlock(&curr->lock);
+    pthread_mutex_unlock(&prev->lock);
+    free(curr);
+    return true;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    list_node_t *prev, *curr;
+
+    bool found = __list_find(list, &key, &prev, &curr);
+    pthread_mutex_unlock(&curr->lock);
+    pthread_mutex_unlock(&prev->lock);
+    return found;
+}
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifndef LIST_BENCH
+
+#define N_ELEMENTS 128
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    list_t *list = arg;
+    // Slight changes to test ordering
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        list_insert(list, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    list_t *list = arg;
+
+    // Keys may not be inserted yet, retry until all of them are gone
+    int deleted = 0;
+    for (int j = 0; j < 1000000 && deleted < N_ELEMENTS; j++) {
+        for (int i = N_ELEMENTS - 1; i >= 0; i--)
+            deleted += list_delete(list, (uintptr_t) &elements[tid()-1][i]);
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+#define N_THREADS 128
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    for (size_t tid = 0; tid < tid_v_base; tid++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
+        }
+    }
+
+    list_node_t *cur = list->head;
+    if (cur->key != 0) {
+        fprintf(stderr, "EXPECTED HEAD, GOT %lu!\n", cur->key);
+        return -1;
+    }
+    if (!atomic_load(&cur->next)) {
+        fprintf(stderr, "MISSING TAIL!\n");
+        return -1;
+    }
+    cur = (list_node_t *) atomic_load(&cur->next);
+    if (cur->key != UINTPTR_MAX) {
+        fprintf(stderr, "EXPECTED TAIL, GOT %lu!\n", cur->key);
+        return -1;
+    }
+
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
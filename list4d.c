@@ -0,0 +1,286 @@
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <threads.h>
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+/*
+ * Flat combining (Hendler, Incze, Shavit & Tzafrir): instead of queueing on
+ * the mutex, every thread publishes its operation in its own slot and waits.
+ * Whichever thread gets the mutex becomes the combiner: it collects all
+ * published operations, sorts them by key, applies them in one forward pass
+ * over the list, and hands every waiter its result. Equal keys are applied
+ * in the order the combiner sorted them, which is their linearization order.
+ * Inserting threads bring their node along and deleting threads free the
+ * node they get back, so the combiner neither allocates nor frees.
+ */
+typedef struct {
+    void            *next;
+    uintptr_t       key;
+} list_node_t;
+
+typedef struct {
+    list_node_t     *head;
+    list_node_t     *tail;
+} list_t;
+
+enum { FC_NONE, FC_INSERT, FC_DELETE, FC_FIND };
+
+typedef struct {
+    alignas(128) atomic_int     op;     // FC_NONE once the result is in
+    uintptr_t                   key;
+    list_node_t                 *node;  // in for insert, out for delete
+    bool                        result;
+} fc_slot_t;
+
+static pthread_mutex_t mutex;
+static fc_slot_t fc_slots[MAX_THREADS + 1];
+
+// Combining passes and the operations they applied, under the mutex
+static unsigned long fc_passes, fc_ops;
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = malloc(sizeof(list_node_t));
+    list_node_t *sentry_tail = malloc(sizeof(list_node_t));
+    sentry_head->next = sentry_tail;
+    sentry_head->key = 0;
+    sentry_tail->key = UINTPTR_MAX;
+
+    list->head = sentry_head;
+    list->tail = sentry_tail;
+    pthread_mutex_init(&mutex, NULL);
+
+    return list;
+}
+
+static int slot_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (*(fc_slot_t * const *) a)->key;
+    uintptr_t y = (*(fc_slot_t * const *) b)->key;
+    return (x > y) - (x < y);
+}
+
+/*
+ * One combining pass, with the mutex held
+ */
+static void __list_combine(list_t *list)
+{
+    fc_slot_t *pending[MAX_THREADS + 1];
+    size_t n = 0, slots = atomic_load(&tid_v_base);
+
+    // Only threads that have a tid can have published anything
+    for (size_t i = 0; i < slots && i <= MAX_THREADS; i++)
+        if (atomic_load_explicit(&fc_slots[i].op, memory_order_acquire))
+            pending[n++] = &fc_slots[i];
+
+    if (n > 1)
+        qsort(pending, n, sizeof(pending[0]), slot_cmp);
+
+    list_node_t **prev = &list->head;
+    list_node_t *curr = *prev;
+
+    for (size_t i = 0; i < n; i++) {
+        fc_slot_t *slot = pending[i];
+        int op = atomic_load_explicit(&slot->op, memory_order_relaxed);
+
+        while (curr->key < slot->key) {
+            prev = (list_node_t **) &curr->next;
+            curr = curr->next;
+        }
+
+        bool found = curr->key == slot->key;
+        switch (op) {
+        case FC_INSERT:
+            if (!found) {
+                // Becomes curr, so later operations on its key see it
+                list_node_t *new = slot->node;
+                new->next = curr;
+                *prev = new;
+                curr = new;
+            }
+            slot->result = !found;
+            break;
+        case FC_DELETE:
+            if (found) {
+                *prev = curr->next;
+                slot->node = curr;
+                curr = *prev;
+            }
+            slot->result = found;
+            break;
+        default:
+            slot->result = found;
+        }
+        atomic_store_explicit(&slot->op, FC_NONE, memory_order_release);
+    }
+
+    fc_passes++;
+    fc_ops += n;
+}
+
+/*
+ * Publish an operation and wait until some combiner, maybe this thread,
+ * has applied it
+ */
+static fc_slot_t *__list_apply(list_t *list, int op, uintptr_t key,
+                               list_node_t *node)
+{
+    fc_slot_t *slot = &fc_slots[tid()];
+
+    slot->key = key;
+    slot->node = node;
+    atomic_store_explicit(&slot->op, op, memory_order_release);
+
+    while (atomic_load_explicit(&slot->op, memory_order_acquire)) {
+        if (pthread_mutex_trylock(&mutex) == 0) {
+            __list_combine(list);
+            pthread_mutex_unlock(&mutex);
+        } else {
+            sched_yield();
+        }
+    }
+    return slot;
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *new = malloc(sizeof(list_node_t));
+    new->key = key;
+
+    if (__list_apply(list, FC_INSERT, key, new)->result)
+        return true;
+
+    free(new);
+    return false;
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    fc_slot_t *slot = __list_apply(list, FC_DELETE, key, NULL);
+
+    if (!slot->result)
+        return false;
+
+    free(slot->node);
+    return true;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    return __list_apply(list, FC_FIND, key, NULL)->result;
+}
+
+#ifndef LIST_BENCH
+
+#define N_ELEMENTS 128
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+static atomic_bool broken;
+
+static void *insert_thread(void *arg)
+{
+    list_t *list = arg;
+    // Slight changes to test ordering
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        list_insert(list, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    list_t *list = arg;
+
+    // Keys may not be inserted yet, retry until all of them are gone. Only
+    // this thread deletes them, so a key it finds must still be there.
+    int deleted = 0;
+    for (int j = 0; j < 1000000 && deleted < N_ELEMENTS; j++) {
+        for (int i = N_ELEMENTS - 1; i >= 0; i--) {
+            uintptr_t key = (uintptr_t) &elements[tid()-1][i];
+            if (!list_find(list, key))
+                continue;
+            if (!list_delete(list, key)) {
+                fprintf(stderr, "KEY %lu FOUND, BUT NOT DELETED!\n", key);
+                atomic_store(&broken, true);
+                return NULL;
+            }
+            deleted++;
+        }
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+#define N_THREADS 128
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    if (broken)
+        return -1;
+
+    for (size_t tid = 0; tid < N_THREADS; tid++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
+        }
+    }
+
+    list_node_t *cur = list->head;
+    if (cur->key != 0) {
+        fprintf(stderr, "EXPECTED HEAD, GOT %lu!\n", cur->key);
+        return -1;
+    }
+    if (!cur->next) {
+        fprintf(stderr, "MISSING TAIL!\n");
+        return -1;
+    }
+    cur = cur->next;
+    if (cur->key != UINTPTR_MAX) {
+        fprintf(stderr, "EXPECTED TAIL, GOT %lu!\n", cur->key);
+        return -1;
+    }
+
+    printf("%lu operations in %lu combining passes\n", fc_ops, fc_passes);
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
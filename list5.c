@@ -1,14 +1,15 @@
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <threads.h>
 
-static atomic_int_fast32_t deleted = ATOMIC_VAR_INIT(0);
-
 #define TID_UNKNOWN -1
 #define MAX_THREADS 128
 
@@ -18,9 +19,27 @@ static atomic_int_fast32_t deleted = ATOMIC_VAR_INIT(0);
 #define get_unmarked(p)         ((uintptr_t)(p) & (~0x01))
 #define get_unmarked_node(p)    ((list_node_t *) get_unmarked(p))
 
+/*
+ * Node layout, picked at build time:
+ *
+ *  default         24-byte nodes (next, key, backlink) from the libc
+ *                  allocator, packed as it likes
+ *  -DNODE_PADDED   every node on its own 128-byte line pair, as in sim1
+ *  -DNODE_ARENA    nodes bump-allocated from pool.h slabs, so the nodes a
+ *                  thread inserts in a row sit next to each other
+ *
+ * The two flags combine. -DLIST_MAP adds the value, making nodes 32 bytes.
+ */
 typedef struct {
+#ifdef NODE_PADDED
+    alignas(128)
+#endif
     atomic_uintptr_t    next;
     uintptr_t           key;
+    atomic_uintptr_t    back;
+#ifdef LIST_MAP
+    atomic_uintptr_t    value;
+#endif
 } list_node_t;
 
 typedef struct {
@@ -28,12 +47,57 @@ typedef struct {
     atomic_uintptr_t    tail;
 } list_t;
 
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifdef NODE_ARENA
+#include "pool.h"
+#else
+static inline list_node_t *node_alloc(void)
+{
+    return aligned_alloc(alignof(list_node_t), sizeof(list_node_t));
+}
+
+static inline void node_free(list_node_t *node)
+{
+    free(node);
+}
+#endif
+
+#include "stats.h"
+#include "backoff.h"
+
+/*
+ * Build with -DLIST_ELIM to pair off inserts and deletes of the same key in
+ * elim.h's array: an update first takes a matching offer waiting there, and
+ * one that would fail, or lost a CAS, waits there a while for its partner.
+ */
+#ifdef LIST_ELIM
+// The test runs more threads than the CPUs it may get
+#ifndef LIST_BENCH
+#define ELIM_WAIT_YIELD
+#endif
+#include "elim.h"
+#else
+#define elim_take(op, key)      false
+#define elim_offer(op, key)     false
+#endif
+
 static list_t *list_new() {
     list_t *list = malloc(sizeof(list_t));
-    list_node_t *sentry_head = malloc(sizeof(list_node_t));
-    list_node_t *sentry_tail = malloc(sizeof(list_node_t));
+    list_node_t *sentry_head = node_alloc();
+    list_node_t *sentry_tail = node_alloc();
 
     atomic_init(&sentry_head->next, (uintptr_t) sentry_tail);
+    atomic_init(&sentry_tail->next, 0);
     sentry_head->key = 0;
     sentry_tail->key = UINTPTR_MAX;
 
@@ -43,17 +107,50 @@ static list_t *list_new() {
     return list;
 }
 
-static bool __list_find(list_t *list,
-                        uintptr_t *key,
-                        atomic_uintptr_t **par_prev,
-                        list_node_t **par_curr,
-                        list_node_t **par_next)
+/*
+ * The node whose next field prev is, NULL for the list head
+ */
+static inline list_node_t *prev_node(list_t *list, atomic_uintptr_t *prev)
+{
+    if (prev == &list->head)
+        return NULL;
+    return (list_node_t *) ((char *) prev - offsetof(list_node_t, next));
+}
+
+/*
+ * Search starting at the next field `from` of a node whose key is below *key.
+ *
+ * On any inconsistency, including that node being deleted, the search backs
+ * up to the nearest unmarked node before the one it was at, following the
+ * backlinks list_delete() leaves in the nodes it marks (Fomitchev & Ruppert),
+ * instead of starting over from the head. An unmarked node is still linked,
+ * so it is as good a place to restart as the head; the head sentinel ends
+ * every chain of backlinks. Build with -DFIND_RESTART_HEAD to always restart
+ * from the head.
+ */
+static bool __list_find_from(list_t *list,
+                             atomic_uintptr_t *from,
+                             uintptr_t *key,
+                             atomic_uintptr_t **par_prev,
+                             list_node_t **par_curr,
+                             list_node_t **par_next)
 {
-    atomic_uintptr_t *prev = NULL;
-    list_node_t *curr = NULL, *next = NULL;
+    atomic_uintptr_t *prev = from;
+    list_node_t *pred = prev_node(list, from), *curr = NULL, *next = NULL;
+    unsigned long visits = 0;
+
+    goto start;
 
 try_again:
-    prev = &list->head;
+    stat_inc(restarts);
+#ifdef FIND_RESTART_HEAD
+    pred = NULL;
+#else
+    while (pred && is_marked(atomic_load(&pred->next)))
+        pred = (list_node_t *) atomic_load(&pred->back);
+#endif
+    prev = pred ? &pred->next : &list->head;
+start:
     curr = (list_node_t *) atomic_load(prev);
 
     if (atomic_load(prev) != get_unmarked(curr)) {
@@ -61,6 +158,7 @@ try_again:
     }
 
     while (true) {
+        visits++;
         next = (list_node_t *) atomic_load(&get_unmarked_node(curr)->next);
 
         if (atomic_load(&get_unmarked_node(curr)->next) != (uintptr_t) next) {
@@ -75,40 +173,67 @@ try_again:
                 *par_curr = curr;
                 *par_prev = prev;
                 *par_next = next;
+                stat_add(visits, visits);
                 return (get_unmarked_node(curr)->key == *key);
             }
-            prev = &get_unmarked_node(curr)->next;
+            pred = get_unmarked_node(curr);
+            prev = &pred->next;
 
         } else {
             //TODO: what if we don't do this?
             uintptr_t tmp = get_unmarked(curr);
-            if (!atomic_compare_exchange_strong(prev, &tmp,
-                                                get_unmarked(next))) {
+            if (!stat_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                         get_unmarked(next)))) {
                 goto try_again;
             }
+            stat_inc(unlinks);
+            next = get_unmarked_node(next);
 
         }
         curr = next;
     }
 }
 
+static bool __list_find(list_t *list,
+                        uintptr_t *key,
+                        atomic_uintptr_t **par_prev,
+                        list_node_t **par_curr,
+                        list_node_t **par_next)
+{
+    return __list_find_from(list, &list->head, key, par_prev, par_curr,
+                            par_next);
+}
+
 static bool list_insert(list_t *list, uintptr_t key)
 {
-    list_node_t *new = malloc(sizeof(list_node_t));
+    stat_inc(ops);
+    if (elim_take(ELIM_INSERT, key))
+        return true;
+
+    list_node_t *new = node_alloc();
     new->key = key;
 
-    atomic_uintptr_t *prev;
+    atomic_uintptr_t *prev = &list->head;
     list_node_t *curr, *next;
 
+    // A failed CAS resumes the search from where it was
     while (true) {
-        if (__list_find(list, &key, &prev, &curr, &next)) {
-            return false;
+        if (__list_find_from(list, prev, &key, &prev, &curr, &next)) {
+            bool paired = elim_offer(ELIM_INSERT, key);
+            node_free(new);
+            return paired;
         }
 
         atomic_store_explicit(&new->next, (uintptr_t) curr,
                               memory_order_relaxed);
         uintptr_t tmp = get_unmarked(curr);
-        if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t) new)) {
+        if (backoff_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                       (uintptr_t) new))) {
+            stat_inc(inserts);
+            return true;
+        }
+        if (elim_offer(ELIM_INSERT, key)) {
+            node_free(new);
             return true;
         }
     }
@@ -116,40 +241,380 @@ static bool list_insert(list_t *list, uintptr_t key)
 
 static bool list_delete(list_t *list, uintptr_t key)
 {
-    atomic_uintptr_t *prev;
+    atomic_uintptr_t *prev = &list->head;
     list_node_t *curr, *next;
 
+    stat_inc(ops);
+    if (elim_take(ELIM_DELETE, key))
+        return true;
+
     while (true) {
-        if (!__list_find(list, &key, &prev, &curr, &next)) {
-            return false;
+        if (!__list_find_from(list, prev, &key, &prev, &curr, &next)) {
+            return elim_offer(ELIM_DELETE, key);
         }
 
+        // Left for searches that find curr marked under them
+        atomic_store(&curr->back, (uintptr_t) prev_node(list, prev));
         uintptr_t tmp = get_unmarked(next);
 
-        if (!atomic_compare_exchange_strong(&curr->next, &tmp,
-                                            get_marked(next))) {
+        if (!backoff_cas(atomic_compare_exchange_strong(&curr->next, &tmp,
+                                                        get_marked(next)))) {
+            if (elim_offer(ELIM_DELETE, key))
+                return true;
             continue;
         }
 
         tmp = get_unmarked(curr);
 
-        atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next));
-        atomic_fetch_add(&deleted, 1);
+        stat_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                get_unmarked(next)));
+        stat_inc(deletes);
         return true;
     }
 }
 
-static thread_local int tid_v = TID_UNKNOWN;
-static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+static int key_cmp(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+    return (x > y) - (x < y);
+}
 
-static inline int tid(void)
+/*
+ * Sort keys in place and insert them in one forward pass: the search for
+ * every key resumes from where the previous one ended.
+ */
+static size_t list_insert_batch(list_t *list, uintptr_t *keys, size_t n)
 {
-    if (tid_v == TID_UNKNOWN) {
-        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next;
+    size_t inserted = 0;
+
+    stat_add(ops, n);
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        if (i && keys[i] == keys[i - 1])
+            continue;
+
+        list_node_t *new = node_alloc();
+        new->key = keys[i];
+
+        while (true) {
+            if (__list_find_from(list, prev, &keys[i], &prev, &curr, &next)) {
+                node_free(new);
+                break;
+            }
+
+            atomic_store_explicit(&new->next, (uintptr_t) curr,
+                                  memory_order_relaxed);
+            uintptr_t tmp = get_unmarked(curr);
+            if (backoff_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                           (uintptr_t) new))) {
+                prev = &new->next;
+                stat_inc(inserts);
+                inserted++;
+                break;
+            }
+        }
     }
-    return tid_v;
+    return inserted;
+}
+
+/*
+ * Sort keys in place and delete them in one forward pass
+ */
+static size_t list_delete_batch(list_t *list, uintptr_t *keys, size_t n)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next;
+    size_t removed = 0;
+
+    stat_add(ops, n);
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        while (true) {
+            if (!__list_find_from(list, prev, &keys[i], &prev, &curr, &next)) {
+                break;
+            }
+
+            atomic_store(&curr->back, (uintptr_t) prev_node(list, prev));
+            uintptr_t tmp = get_unmarked(next);
+
+            if (!backoff_cas(atomic_compare_exchange_strong(
+                    &curr->next, &tmp, get_marked(next)))) {
+                continue;
+            }
+
+            tmp = get_unmarked(curr);
+
+            stat_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                    get_unmarked(next)));
+            stat_inc(deletes);
+            removed++;
+            break;
+        }
+    }
+    return removed;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    stat_inc(ops);
+    return __list_find(list, &key, &prev, &curr, &next);
+}
+
+/*
+ * Read-only lookup: steps over marked nodes instead of unlinking them and
+ * never restarts, so it finishes after at most one step per node.
+ */
+static bool list_contains(list_t *list, uintptr_t key)
+{
+    list_node_t *curr = (list_node_t *) atomic_load(&list->head);
+    unsigned long visits = 0;
+
+    stat_inc(ops);
+    while (curr->key < key) {
+        curr = get_unmarked_node(atomic_load(&curr->next));
+        visits++;
+    }
+    stat_add(visits, visits);
+
+    return curr->key == key && !is_marked(atomic_load(&curr->next));
+}
+
+/*
+ * Lock-free iterator over the keys in [lo, hi)
+ *
+ * Walks like list_contains(), stepping through marked nodes without unlinking
+ * them, and returns the keys of the unmarked nodes it passes. Keys only grow
+ * along any path through the list, marked nodes included, so no key comes
+ * twice, and a key that is present for the whole scan is always reached.
+ * Keys inserted or deleted during the scan may or may not be returned.
+ */
+typedef struct {
+    list_node_t         *curr;
+    uintptr_t           hi;
+} list_iter_t;
+
+static void list_iter_init(list_t *list, list_iter_t *it, uintptr_t lo,
+                           uintptr_t hi)
+{
+    list_node_t *head = (list_node_t *) atomic_load(&list->head);
+    unsigned long visits = 0;
+
+    // Past the head sentinel, whose key 0 is no key of the list
+    list_node_t *curr = get_unmarked_node(atomic_load(&head->next));
+
+    stat_inc(ops);
+    while (curr->key < lo) {
+        curr = get_unmarked_node(atomic_load(&curr->next));
+        visits++;
+    }
+    stat_add(visits, visits);
+
+    it->curr = curr;
+    it->hi = hi;
+}
+
+static bool list_iter_next(list_iter_t *it, uintptr_t *key)
+{
+    unsigned long visits = 0;
+
+    while (it->curr->key < it->hi) {
+        list_node_t *node = it->curr;
+        uintptr_t next = atomic_load(&node->next);
+
+        it->curr = get_unmarked_node(next);
+        visits++;
+        if (!is_marked(next)) {
+            *key = node->key;
+            stat_add(visits, visits);
+            return true;
+        }
+    }
+    stat_add(visits, visits);
+    return false;
 }
 
+#ifdef LIST_MAP
+
+/*
+ * Key-value map on the list, built with -DLIST_MAP
+ *
+ * Every node carries a value word, replaced in place by CAS, so updates to a
+ * present key allocate nothing. A removal first swaps the value for
+ * MAP_DELETED, which is where it takes effect, and only then marks and
+ * unlinks the node like list_delete(); anyone who finds a node so removed
+ * helps finish the mark before it searches again. Values are any word but
+ * MAP_NONE, returned for absent keys, and MAP_DELETED. Maps go through
+ * map_*() only: a list_delete() would leave values to be replaced in
+ * deleted nodes.
+ */
+#define MAP_NONE        ((uintptr_t) 0)
+#define MAP_DELETED     UINTPTR_MAX
+
+typedef uintptr_t (*map_fn_t)(uintptr_t key, void *arg);
+
+/*
+ * Mark and try once to unlink curr, whose value is MAP_DELETED
+ */
+static void __map_unlink(list_t *list, atomic_uintptr_t *prev,
+                         list_node_t *curr)
+{
+    uintptr_t next = atomic_load(&curr->next);
+
+    atomic_store(&curr->back, (uintptr_t) prev_node(list, prev));
+    while (!is_marked(next) &&
+           !backoff_cas(atomic_compare_exchange_strong(&curr->next, &next,
+                                                       get_marked(next))))
+        ;
+
+    uintptr_t tmp = get_unmarked(curr);
+    stat_cas(atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next)));
+}
+
+/*
+ * Link new, holding key and its value, in front of curr at prev
+ */
+static bool __map_link(atomic_uintptr_t *prev, list_node_t *curr,
+                       list_node_t *new)
+{
+    atomic_store_explicit(&new->next, (uintptr_t) curr, memory_order_relaxed);
+    uintptr_t tmp = get_unmarked(curr);
+    if (!backoff_cas(atomic_compare_exchange_strong(prev, &tmp,
+                                                    (uintptr_t) new)))
+        return false;
+    stat_inc(inserts);
+    return true;
+}
+
+/*
+ * Map key to value, returning the value it replaced or MAP_NONE
+ */
+static uintptr_t map_put(list_t *list, uintptr_t key, uintptr_t value)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next, *new = NULL;
+
+    stat_inc(ops);
+    while (true) {
+        if (__list_find_from(list, prev, &key, &prev, &curr, &next)) {
+            uintptr_t old = atomic_load(&curr->value);
+
+            while (old != MAP_DELETED) {
+                if (backoff_cas(atomic_compare_exchange_strong(&curr->value,
+                                                               &old, value))) {
+                    if (new)
+                        node_free(new);
+                    return old;
+                }
+            }
+            __map_unlink(list, prev, curr);
+            continue;
+        }
+
+        if (!new) {
+            new = node_alloc();
+            new->key = key;
+        }
+        atomic_store_explicit(&new->value, value, memory_order_relaxed);
+        if (__map_link(prev, curr, new))
+            return MAP_NONE;
+    }
+}
+
+/*
+ * Read-only like list_contains()
+ */
+static uintptr_t map_get(list_t *list, uintptr_t key)
+{
+    list_node_t *curr = (list_node_t *) atomic_load(&list->head);
+    unsigned long visits = 0;
+
+    stat_inc(ops);
+    while (curr->key < key) {
+        curr = get_unmarked_node(atomic_load(&curr->next));
+        visits++;
+    }
+    stat_add(visits, visits);
+
+    if (curr->key != key)
+        return MAP_NONE;
+
+    uintptr_t value = atomic_load(&curr->value);
+    return value == MAP_DELETED ? MAP_NONE : value;
+}
+
+/*
+ * Remove key, returning its value or MAP_NONE
+ */
+static uintptr_t map_remove(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next;
+
+    stat_inc(ops);
+    if (!__list_find_from(list, prev, &key, &prev, &curr, &next))
+        return MAP_NONE;
+
+    uintptr_t old = atomic_load(&curr->value);
+    while (old != MAP_DELETED) {
+        if (backoff_cas(atomic_compare_exchange_strong(&curr->value, &old,
+                                                       MAP_DELETED))) {
+            __map_unlink(list, prev, curr);
+            stat_inc(deletes);
+            return old;
+        }
+    }
+
+    // Removed by someone else since the search found it
+    __map_unlink(list, prev, curr);
+    return MAP_NONE;
+}
+
+/*
+ * The value of key, or, if it is absent, the value fn(key, arg) returns,
+ * which is then added unless another thread adds key first. fn is called at
+ * most once, and its value is dropped if it loses.
+ */
+static uintptr_t map_compute_if_absent(list_t *list, uintptr_t key,
+                                       map_fn_t fn, void *arg)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next, *new = NULL;
+
+    stat_inc(ops);
+    while (true) {
+        if (__list_find_from(list, prev, &key, &prev, &curr, &next)) {
+            uintptr_t value = atomic_load(&curr->value);
+
+            if (value != MAP_DELETED) {
+                if (new)
+                    node_free(new);
+                return value;
+            }
+            __map_unlink(list, prev, curr);
+            continue;
+        }
+
+        if (!new) {
+            new = node_alloc();
+            new->key = key;
+            atomic_store_explicit(&new->value, fn(key, arg),
+                                  memory_order_relaxed);
+        }
+        if (__map_link(prev, curr, new))
+            return atomic_load_explicit(&new->value, memory_order_relaxed);
+    }
+}
+
+#endif
+
+#ifndef LIST_BENCH
 
 #define N_ELEMENTS 128
 #define N_THREADS 4
@@ -184,6 +649,241 @@ static void *delete_thread(void *arg)
 }
 
 
+#define SCAN_ROUNDS 64
+
+static atomic_bool scan_done = ATOMIC_VAR_INIT(false);
+
+/*
+ * Keys &elements[MAX_THREADS][i] stay for even i and churn for odd i
+ */
+static void *churn_thread(void *arg)
+{
+    list_t *list = arg;
+
+    while (!atomic_load(&scan_done)) {
+        for (size_t i = 1; i < N_ELEMENTS; i += 2)
+            list_insert(list, (uintptr_t) &elements[MAX_THREADS][i]);
+        for (size_t i = 1; i < N_ELEMENTS; i += 2)
+            list_delete(list, (uintptr_t) &elements[MAX_THREADS][i]);
+    }
+    return NULL;
+}
+
+static void *scan_thread(void *arg)
+{
+    list_t *list = arg;
+
+    for (int j = 0; j < SCAN_ROUNDS; j++) {
+        list_iter_t it;
+        uintptr_t key, last = 0;
+        size_t even = 0;
+
+        // Every other scan from 0, where the head sentinel must not show
+        list_iter_init(list, &it,
+                       (j & 1) ? 0 : (uintptr_t) &elements[MAX_THREADS][0],
+                       (uintptr_t) &elements[MAX_THREADS][N_ELEMENTS]);
+        while (list_iter_next(&it, &key)) {
+            if (key <= last) {
+                fprintf(stderr, "SCAN: %lu AFTER %lu!\n", key, last);
+                return (void *) -1;
+            }
+            if (key == (uintptr_t) &elements[MAX_THREADS][2 * even])
+                even++;
+            last = key;
+        }
+        if (even != N_ELEMENTS / 2) {
+            fprintf(stderr, "SCAN: SAW %zu OF %d STABLE KEYS!\n", even,
+                    N_ELEMENTS / 2);
+            return (void *) -1;
+        }
+    }
+    return NULL;
+}
+
+static int scan_test(void)
+{
+    pthread_t thr[N_THREADS];
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_ELEMENTS; i += 2)
+        list_insert(list, (uintptr_t) &elements[MAX_THREADS][i]);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, (i & 1) ? scan_thread : churn_thread,
+                       list);
+
+    int ret = 0;
+    for (size_t i = 1; i < N_THREADS; i += 2) {
+        void *res;
+        pthread_join(thr[i], &res);
+        if (res)
+            ret = -1;
+    }
+    atomic_store(&scan_done, true);
+    for (size_t i = 0; i < N_THREADS; i += 2)
+        pthread_join(thr[i], NULL);
+    return ret;
+}
+
+#ifdef LIST_MAP
+
+#define MAP_HOT_KEYS    4
+#define MAP_KEYS        64
+#define MAP_ROUNDS      4096
+
+static uintptr_t map_computed[N_THREADS][MAP_KEYS];
+
+typedef struct {
+    uintptr_t           put, returned;
+    unsigned long       n_put, n_returned;
+} map_tally_t;
+
+static uintptr_t map_tag(uintptr_t key, void *arg)
+{
+    return ((uintptr_t) (size_t) arg + 1) << 32 | key;
+}
+
+/*
+ * Every thread puts and removes unique values on a few hot keys. Each value
+ * put must come out exactly once: replaced by a put, removed, or left in the
+ * map at the end. Then all threads race to compute the same keys.
+ */
+static void *map_thread(void *arg)
+{
+    list_t *list = arg;
+    size_t id = tid() % N_THREADS;
+    map_tally_t *t = calloc(1, sizeof(*t));
+
+    for (uintptr_t j = 1; j <= MAP_ROUNDS; j++) {
+        uintptr_t key = (j >> 2) % MAP_HOT_KEYS + 1, old;
+
+        if ((j + id) % 4) {
+            uintptr_t value = map_tag(j, (void *) id);
+            old = map_put(list, key, value);
+            t->put += value;
+            t->n_put++;
+        } else {
+            old = map_remove(list, key);
+        }
+        if (old != MAP_NONE) {
+            t->returned += old;
+            t->n_returned++;
+        }
+    }
+
+    for (uintptr_t key = 1; key <= MAP_KEYS; key++)
+        map_computed[id][key - 1] = map_compute_if_absent(
+            list, MAP_HOT_KEYS + key, map_tag, (void *) id);
+
+    return t;
+}
+
+static int map_test(void)
+{
+    pthread_t thr[N_THREADS];
+    map_tally_t sum = {0};
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, map_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++) {
+        map_tally_t *t;
+        pthread_join(thr[i], (void **) &t);
+        sum.put += t->put;
+        sum.returned += t->returned;
+        sum.n_put += t->n_put;
+        sum.n_returned += t->n_returned;
+        free(t);
+    }
+
+    for (uintptr_t key = 1; key <= MAP_HOT_KEYS; key++) {
+        uintptr_t value = map_get(list, key);
+        if (value != MAP_NONE) {
+            sum.returned += value;
+            sum.n_returned++;
+        }
+    }
+    if (sum.put != sum.returned || sum.n_put != sum.n_returned) {
+        fprintf(stderr, "MAP: %lu VALUES PUT, %lu CAME OUT!\n", sum.n_put,
+                sum.n_returned);
+        return -1;
+    }
+
+    for (uintptr_t key = 1; key <= MAP_KEYS; key++) {
+        uintptr_t value = map_get(list, MAP_HOT_KEYS + key);
+        for (size_t i = 0; i < N_THREADS; i++) {
+            if (map_computed[i][key - 1] != value) {
+                fprintf(stderr, "MAP: KEY %lu COMPUTED AS %lx AND %lx!\n",
+                        MAP_HOT_KEYS + key, map_computed[i][key - 1], value);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+#endif
+
+#ifdef LIST_ELIM
+
+#define PAIR_KEYS       2
+#define PAIR_ROUNDS     4096
+
+static atomic_long pair_balance[PAIR_KEYS];
+
+/*
+ * Half the threads insert and half delete the same few keys, so updates
+ * meet in elim.h's slots. However they are paired off, the successful
+ * inserts of a key can only outnumber its deletes by one, when it is left
+ * in the list at the end.
+ */
+static void *pair_thread(void *arg)
+{
+    list_t *list = arg;
+    bool inserter = tid() & 1;
+
+    for (int j = 0; j < PAIR_ROUNDS; j++) {
+        int k = j % PAIR_KEYS;
+        if (inserter ? list_insert(list, k + 1) : list_delete(list, k + 1))
+            atomic_fetch_add(&pair_balance[k], inserter ? 1 : -1);
+    }
+    return NULL;
+}
+
+static int pair_test(void)
+{
+    pthread_t thr[N_THREADS];
+    list_t *list = list_new();
+    list_stat_t before, after;
+
+    list_stats(&before);
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, pair_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+    list_stats(&after);
+
+    for (int k = 0; k < PAIR_KEYS; k++) {
+        if (pair_balance[k] != list_find(list, k + 1)) {
+            fprintf(stderr, "PAIR: KEY %d INSERTED %ld MORE THAN DELETED, "
+                    "%s!\n", k + 1, pair_balance[k],
+                    list_find(list, k + 1) ? "PRESENT" : "ABSENT");
+            return -1;
+        }
+    }
+    unsigned long pairs = (after.eliminated - before.eliminated) / 2;
+    if (!pairs) {
+        fprintf(stderr, "PAIR: NO INSERT AND DELETE PAIRED OFF!\n");
+        return -1;
+    }
+    printf("pairs eliminated %lu\n", pairs);
+    return 0;
+}
+
+#endif
+
 int main() {
     pthread_t thr[N_THREADS];
 
@@ -196,7 +896,73 @@ int main() {
     for (size_t i = 0; i < N_THREADS; i++)
         pthread_join(thr[i], NULL);
 
-    printf("insert %d delete %ld\n", (N_THREADS >> 1) * N_ELEMENTS, deleted);
+    // Every key the insert threads put in, the delete threads took out
+    list_stat_t st;
+    list_stats(&st);
+    printf("insert %d delete %lu\n", (N_THREADS >> 1) * N_ELEMENTS,
+           st.deletes + st.eliminated / 2);
 
-    return 0;
+    // Reversed keys, so the batch calls have to sort them
+    uintptr_t batch[N_ELEMENTS];
+    for (size_t i = 0; i < N_ELEMENTS; i++)
+        batch[i] = (uintptr_t) &elements[0][N_ELEMENTS - 1 - i];
+
+    if (list_insert_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH INSERT FAILED!\n");
+        return -1;
+    }
+    for (size_t i = 0; i < N_ELEMENTS; i++) {
+        if (!list_find(list, batch[i])) {
+            fprintf(stderr, "KEY %lu NOT FOUND AFTER BATCH INSERT!\n",
+                    batch[i]);
+            return -1;
+        }
+    }
+    if (list_delete_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH DELETE FAILED!\n");
+        return -1;
+    }
+
+    // Repeated keys go in once
+    uintptr_t dup[] = { batch[0], batch[0], batch[0], batch[1] };
+    if (list_insert_batch(list, dup, 4) != 2) {
+        fprintf(stderr, "BATCH INSERT OF REPEATED KEYS FAILED!\n");
+        return -1;
+    }
+    if (!list_delete(list, dup[0]) || list_find(list, dup[0])) {
+        fprintf(stderr, "KEY %lu INSERTED MORE THAN ONCE!\n", dup[0]);
+        return -1;
+    }
+    if (!list_delete(list, dup[3])) {
+        fprintf(stderr, "KEY %lu NOT DELETED AFTER BATCH INSERT!\n", dup[3]);
+        return -1;
+    }
+
+    for (size_t tid = 0; tid < tid_v_base; tid++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i]) ||
+                list_contains(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
+        }
+    }
+
+    list_stats(&st);
+    printf("ops %lu cas %lu failed %lu restarts %lu visits %lu unlinks %lu\n",
+           st.ops, st.cas, st.cas_failed, st.restarts, st.visits, st.unlinks);
+#ifdef LIST_ELIM
+    printf("eliminated %lu\n", st.eliminated);
+    if (pair_test())
+        return -1;
+#endif
+
+#ifdef LIST_MAP
+    if (map_test())
+        return -1;
+#endif
+    return scan_test();
 }
+
+#endif
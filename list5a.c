@@ -0,0 +1,506 @@
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <threads.h>
+
+static atomic_int_fast32_t deleted = ATOMIC_VAR_INIT(0);
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+#define is_marked(p)            (bool) ((uintptr_t)(p) &0x01)
+#define get_marked(p)           ((uintptr_t)(p) | (0x01))
+#define get_marked_node(p)      ((list_node_t *) get_marked(p))
+#define get_unmarked(p)         ((uintptr_t)(p) & (~0x01))
+#define get_unmarked_node(p)    ((list_node_t *) get_unmarked(p))
+
+/*
+ * Node layout, picked at build time:
+ *
+ *  default         16-byte nodes from the libc allocator, packed as it likes
+ *  -DNODE_PADDED   next alone on a 128-byte line pair, as in sim1
+ *  -DNODE_ARENA    nodes bump-allocated from pool.h slabs, so the nodes a
+ *                  thread inserts in a row sit next to each other
+ *
+ * The two flags combine.
+ */
+typedef struct {
+#ifdef NODE_PADDED
+    alignas(128)
+#endif
+    atomic_uintptr_t    next;
+    uintptr_t           key;
+} list_node_t;
+
+typedef struct {
+    atomic_uintptr_t    head;
+    atomic_uintptr_t    tail;
+} list_t;
+
+/*
+ * list5 with every atomic given the weakest order it needs instead of seq_cst:
+ *
+ *  - a node is published by the release CAS that links it, and every load of
+ *    a link is an acquire, so a reader that reaches a node sees its key and
+ *    next as they were before the link;
+ *  - CASes that move a link, marking or unlinking, are acq_rel: they pass on
+ *    whatever the thread had acquired about the node they link to;
+ *  - CASes whose failure just retries the loop around them are weak.
+ */
+#define LOAD(p)     atomic_load_explicit(p, memory_order_acquire)
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifdef NODE_ARENA
+#include "pool.h"
+#else
+static inline list_node_t *node_alloc(void)
+{
+    return aligned_alloc(alignof(list_node_t), sizeof(list_node_t));
+}
+
+static inline void node_free(list_node_t *node)
+{
+    free(node);
+}
+#endif
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = node_alloc();
+    list_node_t *sentry_tail = node_alloc();
+
+    atomic_init(&sentry_head->next, (uintptr_t) sentry_tail);
+    atomic_init(&sentry_tail->next, 0);
+    sentry_head->key = 0;
+    sentry_tail->key = UINTPTR_MAX;
+
+    atomic_init(&list->head, (uintptr_t) sentry_head);
+    atomic_init(&list->tail, (uintptr_t) sentry_tail);
+
+    return list;
+}
+
+/*
+ * Search starting at the next field `from` of a node whose key is below *key.
+ * Any inconsistency, including that node being deleted, restarts the search
+ * from the head.
+ */
+static bool __list_find_from(list_t *list,
+                             atomic_uintptr_t *from,
+                             uintptr_t *key,
+                             atomic_uintptr_t **par_prev,
+                             list_node_t **par_curr,
+                             list_node_t **par_next)
+{
+    atomic_uintptr_t *prev = from;
+    list_node_t *curr = NULL, *next = NULL;
+
+    goto start;
+
+try_again:
+    prev = &list->head;
+start:
+    curr = (list_node_t *) LOAD(prev);
+
+    if (LOAD(prev) != get_unmarked(curr)) {
+        goto try_again;
+    }
+
+    while (true) {
+        next = (list_node_t *) LOAD(&get_unmarked_node(curr)->next);
+
+        if (LOAD(&get_unmarked_node(curr)->next) != (uintptr_t) next) {
+            goto try_again;
+        }
+        if (LOAD(prev) != get_unmarked(curr)) {
+            goto try_again;
+        }
+
+        if (get_unmarked_node(next) == next) {
+            if (!(get_unmarked_node(curr)->key < *key)) {
+                *par_curr = curr;
+                *par_prev = prev;
+                *par_next = next;
+                return (get_unmarked_node(curr)->key == *key);
+            }
+            prev = &get_unmarked_node(curr)->next;
+
+        } else {
+            //TODO: what if we don't do this?
+            uintptr_t tmp = get_unmarked(curr);
+            if (!atomic_compare_exchange_strong_explicit(prev, &tmp,
+                                                         get_unmarked(next),
+                                                         memory_order_acq_rel,
+                                                         memory_order_relaxed)) {
+                goto try_again;
+            }
+            next = get_unmarked_node(next);
+
+        }
+        curr = next;
+    }
+}
+
+static bool __list_find(list_t *list,
+                        uintptr_t *key,
+                        atomic_uintptr_t **par_prev,
+                        list_node_t **par_curr,
+                        list_node_t **par_next)
+{
+    return __list_find_from(list, &list->head, key, par_prev, par_curr,
+                            par_next);
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *new = node_alloc();
+    new->key = key;
+
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    while (true) {
+        if (__list_find(list, &key, &prev, &curr, &next)) {
+            node_free(new);
+            return false;
+        }
+
+        atomic_store_explicit(&new->next, (uintptr_t) curr,
+                              memory_order_relaxed);
+        uintptr_t tmp = get_unmarked(curr);
+        if (atomic_compare_exchange_weak_explicit(prev, &tmp, (uintptr_t) new,
+                                                  memory_order_release,
+                                                  memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    while (true) {
+        if (!__list_find(list, &key, &prev, &curr, &next)) {
+            return false;
+        }
+
+        uintptr_t tmp = get_unmarked(next);
+
+        if (!atomic_compare_exchange_weak_explicit(&curr->next, &tmp,
+                                                   get_marked(next),
+                                                   memory_order_acq_rel,
+                                                   memory_order_relaxed)) {
+            continue;
+        }
+
+        tmp = get_unmarked(curr);
+
+        atomic_compare_exchange_strong_explicit(prev, &tmp, get_unmarked(next),
+                                                memory_order_acq_rel,
+                                                memory_order_relaxed);
+        atomic_fetch_add_explicit(&deleted, 1, memory_order_relaxed);
+        return true;
+    }
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sort keys in place and insert them in one forward pass: the search for
+ * every key resumes from where the previous one ended.
+ */
+static size_t list_insert_batch(list_t *list, uintptr_t *keys, size_t n)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next;
+    size_t inserted = 0;
+
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        if (i && keys[i] == keys[i - 1])
+            continue;
+
+        list_node_t *new = node_alloc();
+        new->key = keys[i];
+
+        while (true) {
+            if (__list_find_from(list, prev, &keys[i], &prev, &curr, &next)) {
+                node_free(new);
+                break;
+            }
+
+            atomic_store_explicit(&new->next, (uintptr_t) curr,
+                                  memory_order_relaxed);
+            uintptr_t tmp = get_unmarked(curr);
+            if (atomic_compare_exchange_weak_explicit(prev, &tmp,
+                                                      (uintptr_t) new,
+                                                      memory_order_release,
+                                                      memory_order_relaxed)) {
+                prev = &new->next;
+                inserted++;
+                break;
+            }
+        }
+    }
+    return inserted;
+}
+
+/*
+ * Sort keys in place and delete them in one forward pass
+ */
+static size_t list_delete_batch(list_t *list, uintptr_t *keys, size_t n)
+{
+    atomic_uintptr_t *prev = &list->head;
+    list_node_t *curr, *next;
+    size_t removed = 0;
+
+    qsort(keys, n, sizeof(keys[0]), key_cmp);
+
+    for (size_t i = 0; i < n; i++) {
+        if (i && keys[i] == keys[i - 1])
+            continue;
+
+        while (true) {
+            if (!__list_find_from(list, prev, &keys[i], &prev, &curr, &next)) {
+                break;
+            }
+
+            uintptr_t tmp = get_unmarked(next);
+
+            if (!atomic_compare_exchange_weak_explicit(&curr->next, &tmp,
+                                                       get_marked(next),
+                                                       memory_order_acq_rel,
+                                                       memory_order_relaxed)) {
+                continue;
+            }
+
+            tmp = get_unmarked(curr);
+
+            atomic_compare_exchange_strong_explicit(prev, &tmp,
+                                                    get_unmarked(next),
+                                                    memory_order_acq_rel,
+                                                    memory_order_relaxed);
+            atomic_fetch_add_explicit(&deleted, 1, memory_order_relaxed);
+            removed++;
+            break;
+        }
+    }
+    return removed;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+    return __list_find(list, &key, &prev, &curr, &next);
+}
+
+/*
+ * Read-only lookup: steps over marked nodes instead of unlinking them and
+ * never restarts, so it finishes after at most one step per node.
+ */
+static bool list_contains(list_t *list, uintptr_t key)
+{
+    list_node_t *curr = (list_node_t *) LOAD(&list->head);
+
+    while (curr->key < key)
+        curr = get_unmarked_node(LOAD(&curr->next));
+
+    return curr->key == key && !is_marked(LOAD(&curr->next));
+}
+
+#ifndef LIST_BENCH
+
+#define N_ELEMENTS 128
+#define N_THREADS 4
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    list_t *list = arg;
+
+    // Slight changes to test ordering
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        list_insert(list, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    list_t *list = arg;
+
+    int deleted = 0;
+    for (int j = 0; j < 1000000; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++)
+            deleted += list_delete(list, (uintptr_t) &elements[tid()-1][i]);
+        if (deleted == N_ELEMENTS) {
+            printf("\t\t break at %d\n", j);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Message-passing litmus test: writers keep linking freshly written nodes
+ * and marking them again while readers walk the list and check the keys they
+ * reach. A publish that is not a release or a load that is not an acquire
+ * shows up as a key out of order on weak hardware, and as a data race on the
+ * key under -fsanitize=thread.
+ */
+#define LITMUS_ROUNDS 32
+
+static atomic_bool litmus_done = ATOMIC_VAR_INIT(false);
+
+static void *litmus_writer(void *arg)
+{
+    list_t *list = arg;
+
+    for (int j = 0; j < LITMUS_ROUNDS; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++)
+            list_insert(list, (uintptr_t) &elements[tid()][i]);
+        for (size_t i = 0; i < N_ELEMENTS; i++)
+            list_delete(list, (uintptr_t) &elements[tid()][i]);
+    }
+    return NULL;
+}
+
+static void *litmus_reader(void *arg)
+{
+    list_t *list = arg;
+
+    while (!atomic_load_explicit(&litmus_done, memory_order_relaxed)) {
+        list_node_t *curr = (list_node_t *) LOAD(&list->head);
+        while (curr->key != UINTPTR_MAX) {
+            list_node_t *next = get_unmarked_node(LOAD(&curr->next));
+            if (!(curr->key < next->key)) {
+                fprintf(stderr, "LITMUS: %lu BEFORE %lu\n",
+                        curr->key, next->key);
+                exit(-1);
+            }
+            curr = next;
+        }
+    }
+    return NULL;
+}
+
+static int litmus(list_t *list)
+{
+    pthread_t thr[N_THREADS];
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, (i & 1) ? litmus_reader : litmus_writer,
+                       list);
+
+    for (size_t i = 0; i < N_THREADS; i += 2)
+        pthread_join(thr[i], NULL);
+    atomic_store(&litmus_done, true);
+    for (size_t i = 1; i < N_THREADS; i += 2)
+        pthread_join(thr[i], NULL);
+
+    // Marked nodes a failed unlink left behind are fine, live ones are not
+    list_node_t *curr = (list_node_t *) LOAD(&list->head);
+    while (curr->key != UINTPTR_MAX) {
+        uintptr_t next = LOAD(&curr->next);
+        if (curr->key && !is_marked(next)) {
+            fprintf(stderr, "LITMUS: KEY %lu LEFT AFTER DELETE!\n", curr->key);
+            return -1;
+        }
+        curr = get_unmarked_node(next);
+    }
+    return 0;
+}
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, (i & 1) ? delete_thread : insert_thread,
+                       list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    // Every key the insert threads put in, the delete threads took out
+    printf("insert %d delete %ld\n", (N_THREADS >> 1) * N_ELEMENTS, deleted);
+
+    // Reversed keys, so the batch calls have to sort them
+    uintptr_t batch[N_ELEMENTS];
+    for (size_t i = 0; i < N_ELEMENTS; i++)
+        batch[i] = (uintptr_t) &elements[0][N_ELEMENTS - 1 - i];
+
+    if (list_insert_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH INSERT FAILED!\n");
+        return -1;
+    }
+    for (size_t i = 0; i < N_ELEMENTS; i++) {
+        if (!list_find(list, batch[i])) {
+            fprintf(stderr, "KEY %lu NOT FOUND AFTER BATCH INSERT!\n",
+                    batch[i]);
+            return -1;
+        }
+    }
+    if (list_delete_batch(list, batch, N_ELEMENTS) != N_ELEMENTS) {
+        fprintf(stderr, "BATCH DELETE FAILED!\n");
+        return -1;
+    }
+
+    // Repeated keys go in once
+    uintptr_t dup[] = { batch[0], batch[0], batch[0], batch[1] };
+    if (list_insert_batch(list, dup, 4) != 2) {
+        fprintf(stderr, "BATCH INSERT OF REPEATED KEYS FAILED!\n");
+        return -1;
+    }
+    if (!list_delete(list, dup[0]) || list_find(list, dup[0])) {
+        fprintf(stderr, "KEY %lu INSERTED MORE THAN ONCE!\n", dup[0]);
+        return -1;
+    }
+    if (!list_delete(list, dup[3])) {
+        fprintf(stderr, "KEY %lu NOT DELETED AFTER BATCH INSERT!\n", dup[3]);
+        return -1;
+    }
+
+    for (size_t tid = 0; tid < tid_v_base; tid++) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i]) ||
+                list_contains(list, (uintptr_t) &elements[tid][i])) {
+                fprintf(stderr, "KEY %lu FOUND AFTER DELETE!\n",
+                        (uintptr_t) &elements[tid][i]);
+                return -1;
+            }
+        }
+    }
+
+    if (litmus(list_new()))
+        return -1;
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,572 @@
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <threads.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+#define is_marked(p)            (bool) ((uintptr_t)(p) &0x01)
+#define get_marked(p)           ((uintptr_t)(p) | (0x01))
+#define get_marked_node(p)      ((list_node_t *) get_marked(p))
+#define get_unmarked(p)         ((uintptr_t)(p) & (~0x01))
+#define get_unmarked_node(p)    ((list_node_t *) get_unmarked(p))
+
+typedef struct {
+    atomic_uintptr_t    next;
+    uintptr_t           key;
+} list_node_t;
+
+typedef struct {
+    atomic_uintptr_t    head;
+    atomic_uintptr_t    tail;
+} list_t;
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#include "pool.h"
+
+/*
+ * Memory reclamation, selected at build time:
+ *
+ *  (default)       hazard pointers
+ *  -DRECLAIM_EBR   epoch-based reclamation
+ *  -DRECLAIM_NONE  never free unlinked nodes, as list5
+ *
+ * reclaim_enter() and reclaim_exit() bracket every list operation,
+ * reclaim_protect() publishes a node that is about to be dereferenced and
+ * reclaim_retire() takes a node that has just been unlinked from the list.
+ */
+typedef struct {
+    alignas(128) atomic_size_t      retired;
+    atomic_size_t                   freed;
+} reclaim_stat_t;
+
+static reclaim_stat_t reclaim_stat[MAX_THREADS];
+
+static inline void reclaim_count(atomic_size_t *c, size_t n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+#define HP_NEXT                 0
+#define HP_CURR                 1
+#define HP_PREV                 2
+
+#if defined(RECLAIM_NONE)
+
+#define reclaim_enter()             ((void) 0)
+#define reclaim_exit()              ((void) 0)
+#define reclaim_protect(slot, p)    ((void) 0)
+
+static void reclaim_retire(list_node_t *node)
+{
+    reclaim_count(&reclaim_stat[tid()].retired, 1);
+}
+
+#elif defined(RECLAIM_EBR)
+
+/*
+ * Epoch-based reclamation
+ *
+ * Threads announce the global epoch they run in for the duration of an
+ * operation. The epoch is only advanced once every active thread has
+ * announced the current one, so a node retired while the global epoch was e
+ * can no longer be referenced once the global epoch reaches e + 2. Retired
+ * nodes wait in one of three limbo lists per thread, tagged with their epoch.
+ */
+#define EBR_ACTIVE              0x01
+#define EBR_LIMBO_LISTS         3
+#define EBR_ADVANCE_THRESHOLD   64
+
+typedef struct {
+    alignas(128) atomic_uint_fast64_t   announce;
+} ebr_slot_t;
+
+typedef struct {
+    list_node_t     **list;
+    size_t          count;
+    size_t          size;
+    uint64_t        epoch;
+} ebr_limbo_t;
+
+typedef struct {
+    alignas(128) ebr_limbo_t    limbo[EBR_LIMBO_LISTS];
+    uint64_t                    seen;
+    size_t                      since_advance;
+} ebr_thread_t;
+
+static alignas(128) atomic_uint_fast64_t ebr_epoch = ATOMIC_VAR_INIT(0);
+static ebr_slot_t ebr_slot[MAX_THREADS];
+static ebr_thread_t ebr_thread[MAX_THREADS];
+
+static void ebr_free(ebr_limbo_t *l)
+{
+    for (size_t i = 0; i < l->count; i++)
+        node_free(l->list[i]);
+    reclaim_count(&reclaim_stat[tid()].freed, l->count);
+    l->count = 0;
+}
+
+static void ebr_collect(ebr_thread_t *t, uint64_t epoch)
+{
+    for (int i = 0; i < EBR_LIMBO_LISTS; i++) {
+        if (t->limbo[i].count && t->limbo[i].epoch + 2 <= epoch)
+            ebr_free(&t->limbo[i]);
+    }
+    t->seen = epoch;
+}
+
+static void ebr_try_advance(void)
+{
+    uint64_t epoch = atomic_load(&ebr_epoch);
+    size_t threads = atomic_load(&tid_v_base);
+
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    for (size_t i = 0; i < threads; i++) {
+        uint64_t a = atomic_load(&ebr_slot[i].announce);
+        if ((a & EBR_ACTIVE) && (a >> 1) != epoch)
+            return;
+    }
+    atomic_compare_exchange_strong(&ebr_epoch, &epoch, epoch + 1);
+}
+
+static inline void reclaim_enter(void)
+{
+    ebr_thread_t *t = &ebr_thread[tid()];
+    uint64_t epoch = atomic_load(&ebr_epoch);
+
+    atomic_store(&ebr_slot[tid()].announce, (epoch << 1) | EBR_ACTIVE);
+    if (epoch != t->seen)
+        ebr_collect(t, epoch);
+}
+
+static inline void reclaim_exit(void)
+{
+    atomic_store_explicit(&ebr_slot[tid()].announce, 0, memory_order_release);
+}
+
+#define reclaim_protect(slot, p)    ((void) 0)
+
+static void reclaim_retire(list_node_t *node)
+{
+    ebr_thread_t *t = &ebr_thread[tid()];
+    uint64_t epoch = atomic_load(&ebr_epoch);
+    ebr_limbo_t *l = &t->limbo[epoch % EBR_LIMBO_LISTS];
+
+    if (l->epoch != epoch) {
+        ebr_free(l);
+        l->epoch = epoch;
+    }
+    if (l->count == l->size) {
+        l->size = l->size ? l->size * 2 : EBR_ADVANCE_THRESHOLD;
+        l->list = realloc(l->list, l->size * sizeof(l->list[0]));
+    }
+    l->list[l->count++] = node;
+    reclaim_count(&reclaim_stat[tid()].retired, 1);
+
+    if (++t->since_advance == EBR_ADVANCE_THRESHOLD) {
+        t->since_advance = 0;
+        ebr_try_advance();
+    }
+}
+
+#else
+
+/*
+ * Hazard pointers
+ *
+ * A node may only be dereferenced after it has been published in one of the
+ * calling thread's slots and then found to be still reachable. Unlinked nodes
+ * are retired to a per-thread list, which is scanned against every published
+ * slot once it is full; nodes that nobody protects are freed as one batch.
+ */
+#define HP_PER_THREAD           3
+#define HP_RETIRE_THRESHOLD     (2 * HP_PER_THREAD * MAX_THREADS)
+
+typedef struct {
+    alignas(128) atomic_uintptr_t   ptr[HP_PER_THREAD];
+} hp_slot_t;
+
+typedef struct {
+    alignas(128) list_node_t        *list[HP_RETIRE_THRESHOLD];
+    size_t                          count;
+} hp_retired_t;
+
+static hp_slot_t hp[MAX_THREADS];
+static hp_retired_t hp_retired[MAX_THREADS];
+
+static int hp_cmp(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void hp_scan(hp_retired_t *r)
+{
+    uintptr_t plist[MAX_THREADS * HP_PER_THREAD];
+    size_t n = 0, kept = 0, threads = atomic_load(&tid_v_base);
+
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    for (size_t i = 0; i < threads; i++) {
+        for (int j = 0; j < HP_PER_THREAD; j++) {
+            uintptr_t p = atomic_load(&hp[i].ptr[j]);
+            if (p)
+                plist[n++] = p;
+        }
+    }
+    qsort(plist, n, sizeof(plist[0]), hp_cmp);
+
+    for (size_t i = 0; i < r->count; i++) {
+        uintptr_t p = (uintptr_t) r->list[i];
+        if (bsearch(&p, plist, n, sizeof(plist[0]), hp_cmp)) {
+            r->list[kept++] = r->list[i];
+        } else {
+            node_free(r->list[i]);
+        }
+    }
+    reclaim_count(&reclaim_stat[tid()].freed, r->count - kept);
+    r->count = kept;
+}
+
+#define reclaim_enter()             ((void) 0)
+
+static inline void reclaim_exit(void)
+{
+    for (int i = 0; i < HP_PER_THREAD; i++)
+        atomic_store_explicit(&hp[tid()].ptr[i], 0, memory_order_release);
+}
+
+static inline void reclaim_protect(int slot, uintptr_t p)
+{
+    atomic_store(&hp[tid()].ptr[slot], get_unmarked(p));
+}
+
+static void reclaim_retire(list_node_t *node)
+{
+    hp_retired_t *r = &hp_retired[tid()];
+
+    r->list[r->count++] = node;
+    reclaim_count(&reclaim_stat[tid()].retired, 1);
+    if (r->count == HP_RETIRE_THRESHOLD)
+        hp_scan(r);
+}
+
+#endif
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = malloc(sizeof(list_node_t));
+    list_node_t *sentry_tail = malloc(sizeof(list_node_t));
+
+    atomic_init(&sentry_head->next, (uintptr_t) sentry_tail);
+    atomic_init(&sentry_tail->next, 0);
+    sentry_head->key = 0;
+    sentry_tail->key = UINTPTR_MAX;
+
+    atomic_init(&list->head, (uintptr_t) sentry_head);
+    atomic_init(&list->tail, (uintptr_t) sentry_tail);
+
+    return list;
+}
+
+/*
+ * Must be called between reclaim_enter() and reclaim_exit(); prev, curr
+ * and next stay protected until the latter.
+ *
+ * The three hazard slots rotate with the nodes: a step forward hands the
+ * slot of curr to prev and that of next to curr, and unlinking curr hands
+ * curr the slot of next, so every step publishes only the new next.
+ */
+static bool __list_find(list_t *list,
+                        uintptr_t *key,
+                        atomic_uintptr_t **par_prev,
+                        list_node_t **par_curr,
+                        list_node_t **par_next)
+{
+    atomic_uintptr_t *prev = NULL;
+    list_node_t *curr = NULL, *next = NULL;
+    int hp_prev = HP_PREV, hp_curr = HP_CURR, hp_next = HP_NEXT, hp_free;
+
+try_again:
+    prev = &list->head;
+    curr = (list_node_t *) atomic_load(prev);
+    reclaim_protect(hp_curr, (uintptr_t) curr);
+
+    if (atomic_load(prev) != get_unmarked(curr)) {
+        goto try_again;
+    }
+
+    while (true) {
+        next = (list_node_t *) atomic_load(&curr->next);
+        reclaim_protect(hp_next, (uintptr_t) next);
+
+        if (atomic_load(&curr->next) != (uintptr_t) next) {
+            goto try_again;
+        }
+        if (atomic_load(prev) != get_unmarked(curr)) {
+            goto try_again;
+        }
+
+        if (get_unmarked_node(next) == next) {
+            if (!(curr->key < *key)) {
+                *par_curr = curr;
+                *par_prev = prev;
+                *par_next = next;
+                return (curr->key == *key);
+            }
+            prev = &curr->next;
+            hp_free = hp_prev;
+            hp_prev = hp_curr;
+
+        } else {
+            uintptr_t tmp = get_unmarked(curr);
+            if (!atomic_compare_exchange_strong(prev, &tmp,
+                                                get_unmarked(next))) {
+                goto try_again;
+            }
+            reclaim_retire(curr);
+            hp_free = hp_curr;
+        }
+        curr = get_unmarked_node(next);
+        hp_curr = hp_next;
+        hp_next = hp_free;
+    }
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    reclaim_enter();
+    bool found = __list_find(list, &key, &prev, &curr, &next);
+    reclaim_exit();
+    return found;
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *new = node_alloc();
+    new->key = key;
+
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    reclaim_enter();
+    while (true) {
+        if (__list_find(list, &key, &prev, &curr, &next)) {
+            reclaim_exit();
+            node_free(new);
+            return false;
+        }
+
+        atomic_store_explicit(&new->next, (uintptr_t) curr,
+                              memory_order_relaxed);
+        uintptr_t tmp = (uintptr_t) curr;
+        if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t) new)) {
+            reclaim_exit();
+            return true;
+        }
+    }
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    atomic_uintptr_t *prev;
+    list_node_t *curr, *next;
+
+    reclaim_enter();
+    while (true) {
+        if (!__list_find(list, &key, &prev, &curr, &next)) {
+            reclaim_exit();
+            return false;
+        }
+
+        uintptr_t tmp = (uintptr_t) next;
+
+        if (!atomic_compare_exchange_strong(&curr->next, &tmp,
+                                            get_marked(next))) {
+            continue;
+        }
+
+        tmp = (uintptr_t) curr;
+        if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t) next)) {
+            reclaim_retire(curr);
+        }
+        reclaim_exit();
+        return true;
+    }
+}
+
+
+#ifndef LIST_BENCH
+
+/*
+ * Churn benchmark: every thread inserts, deletes and looks up random keys
+ * from a small range for a fixed time. Resident memory is sampled once a
+ * second; with reclamation it levels off, with -DRECLAIM_NONE it keeps
+ * growing. Without lookups it is allocation-bound, which compares the node
+ * pool against -DALLOC_MALLOC. A high lookup share compares the read-path
+ * cost of the backends.
+ *
+ *  ./list6 [threads] [seconds] [key range] [lookup %]
+ */
+#define N_THREADS   4
+#define DURATION    10
+#define KEY_RANGE   1024
+#define LOOKUP_PCT  0
+
+typedef struct {
+    alignas(128) atomic_ulong   ops;
+} counter_t;
+
+static counter_t ops[MAX_THREADS];
+static atomic_bool stop = ATOMIC_VAR_INIT(false);
+static uintptr_t key_range = KEY_RANGE;
+static unsigned lookup_pct = LOOKUP_PCT;
+
+static inline uint64_t xorshift64(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void *churn_thread(void *arg)
+{
+    list_t *list = arg;
+    counter_t *c = &ops[tid()];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (tid() + 1);
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        uint64_t r = xorshift64(&seed);
+        uintptr_t key = (r >> 8) % key_range + 1;
+        unsigned op = r % 100;
+
+        if (op < lookup_pct)
+            list_find(list, key);
+        else if ((op - lookup_pct) & 1)
+            list_insert(list, key);
+        else
+            list_delete(list, key);
+
+        atomic_store_explicit(&c->ops,
+                              atomic_load_explicit(&c->ops,
+                                                   memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static long rss_kb(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%*s %ld", &pages) != 1)
+            pages = 0;
+        fclose(f);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static unsigned long total_ops(void)
+{
+    unsigned long sum = 0;
+    for (size_t i = 0; i < MAX_THREADS; i++)
+        sum += atomic_load_explicit(&ops[i].ops, memory_order_relaxed);
+    return sum;
+}
+
+static size_t total_pending(void)
+{
+    size_t sum = 0;
+    for (size_t i = 0; i < MAX_THREADS; i++)
+        sum += atomic_load_explicit(&reclaim_stat[i].retired,
+                                    memory_order_relaxed) -
+               atomic_load_explicit(&reclaim_stat[i].freed,
+                                    memory_order_relaxed);
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n_threads = argc > 1 ? strtoul(argv[1], NULL, 0) : N_THREADS;
+    int duration = argc > 2 ? atoi(argv[2]) : DURATION;
+    if (argc > 3)
+        key_range = strtoul(argv[3], NULL, 0);
+    if (argc > 4)
+        lookup_pct = atoi(argv[4]);
+
+    if (n_threads < 1 || n_threads > MAX_THREADS || key_range < 1 ||
+        lookup_pct > 100) {
+        fprintf(stderr, "usage: %s [threads] [seconds] [key range] "
+                "[lookup %%]\n", argv[0]);
+        return -1;
+    }
+
+    pthread_t thr[MAX_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < n_threads; i++)
+        pthread_create(&thr[i], NULL, churn_thread, list);
+
+    unsigned long last = 0;
+    for (int s = 1; s <= duration; s++) {
+        sleep(1);
+        unsigned long now = total_ops();
+        printf("%3ds %12lu ops/s %8ld KB rss %8zu pending\n",
+               s, now - last, rss_kb(), total_pending());
+        last = now;
+    }
+    atomic_store(&stop, true);
+
+    for (size_t i = 0; i < n_threads; i++)
+        pthread_join(thr[i], NULL);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("total %lu ops, %.0f ops/s, peak rss %ld KB\n",
+           last, (double) last / duration, ru.ru_maxrss);
+
+    list_node_t *cur = (list_node_t *) atomic_load(&list->head);
+    while (cur->key != UINTPTR_MAX) {
+        list_node_t *next = (list_node_t *) atomic_load(&cur->next);
+        next = get_unmarked_node(next);
+        if (!(cur->key < next->key)) {
+            fprintf(stderr, "UNEXPECTED ORDERING, %lu BEFORE %lu\n",
+                    cur->key, next->key);
+            return -1;
+        }
+        cur = next;
+    }
+
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <threads.h>
+
+static atomic_int_fast32_t deleted = ATOMIC_VAR_INIT(0);
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+#define MAX_LEVEL   24
+
+#define is_marked(p)            (bool) ((uintptr_t)(p) &0x01)
+#define get_marked(p)           ((uintptr_t)(p) | (0x01))
+#define get_marked_node(p)      ((list_node_t *) get_marked(p))
+#define get_unmarked(p)         ((uintptr_t)(p) & (~0x01))
+#define get_unmarked_node(p)    ((list_node_t *) get_unmarked(p))
+
+/*
+ * Every node is linked into levels [0, level). Level 0 is the list5 list and
+ * decides membership; the levels above are shortcuts into it. A node is
+ * deleted by marking its next pointers from the top level down, the mark on
+ * level 0 being the linearization point, and unlinked by the next search.
+ */
+typedef struct {
+    uintptr_t           key;
+    int                 level;
+    atomic_uintptr_t    next[];
+} list_node_t;
+
+typedef struct {
+    atomic_uintptr_t    head;
+    atomic_uintptr_t    tail;
+} list_t;
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+static thread_local uint64_t level_seed;
+
+/*
+ * Geometric distribution with p = 1/2, as in Pugh's skip list
+ */
+static int random_level(void)
+{
+    if (!level_seed)
+        level_seed = 0x9E3779B97F4A7C15ULL * (tid() + 1);
+
+    level_seed ^= level_seed << 13;
+    level_seed ^= level_seed >> 7;
+    level_seed ^= level_seed << 17;
+
+    return __builtin_ctzll(level_seed | (1ULL << (MAX_LEVEL - 1))) + 1;
+}
+
+static list_node_t *node_new(uintptr_t key, int level)
+{
+    list_node_t *node = malloc(sizeof(list_node_t) +
+                               level * sizeof(atomic_uintptr_t));
+    node->key = key;
+    node->level = level;
+    return node;
+}
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = node_new(0, MAX_LEVEL);
+    list_node_t *sentry_tail = node_new(UINTPTR_MAX, MAX_LEVEL);
+
+    for (int i = 0; i < MAX_LEVEL; i++) {
+        atomic_init(&sentry_head->next[i], (uintptr_t) sentry_tail);
+        atomic_init(&sentry_tail->next[i], 0);
+    }
+
+    atomic_init(&list->head, (uintptr_t) sentry_head);
+    atomic_init(&list->tail, (uintptr_t) sentry_tail);
+
+    return list;
+}
+
+/*
+ * Fill preds/succs with the last node before key and the first node not
+ * before key on every level, unlinking marked nodes on the way.
+ */
+static bool __list_find(list_t *list,
+                        uintptr_t *key,
+                        list_node_t **preds,
+                        list_node_t **succs)
+{
+    list_node_t *pred = NULL, *curr = NULL, *next = NULL;
+
+try_again:
+    pred = (list_node_t *) atomic_load(&list->head);
+
+    for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+        curr = get_unmarked_node(atomic_load(&pred->next[level]));
+
+        while (true) {
+            next = (list_node_t *) atomic_load(&curr->next[level]);
+
+            while (is_marked(next)) {
+                uintptr_t tmp = (uintptr_t) curr;
+                if (!atomic_compare_exchange_strong(&pred->next[level], &tmp,
+                                                    get_unmarked(next))) {
+                    goto try_again;
+                }
+                curr = get_unmarked_node(next);
+                next = (list_node_t *) atomic_load(&curr->next[level]);
+            }
+
+            if (!(curr->key < *key))
+                break;
+            pred = curr;
+            curr = next;
+        }
+
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+
+    return (succs[0]->key == *key);
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    list_node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    return __list_find(list, &key, preds, succs);
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    list_node_t *new = node_new(key, random_level());
+
+    while (true) {
+        if (__list_find(list, &key, preds, succs)) {
+            free(new);
+            return false;
+        }
+
+        for (int i = 0; i < new->level; i++)
+            atomic_store_explicit(&new->next[i], (uintptr_t) succs[i],
+                                  memory_order_relaxed);
+
+        uintptr_t tmp = (uintptr_t) succs[0];
+        if (atomic_compare_exchange_strong(&preds[0]->next[0], &tmp,
+                                           (uintptr_t) new)) {
+            break;
+        }
+    }
+
+    // Linked on level 0, the shortcuts above are best effort
+    for (int i = 1; i < new->level; i++) {
+        while (true) {
+            uintptr_t tmp = (uintptr_t) succs[i];
+            if (atomic_compare_exchange_strong(&preds[i]->next[i], &tmp,
+                                               (uintptr_t) new)) {
+                break;
+            }
+
+            if (!__list_find(list, &key, preds, succs) || succs[0] != new)
+                return true;
+
+            tmp = atomic_load(&new->next[i]);
+            if (is_marked(tmp))
+                return true;
+            if (tmp != (uintptr_t) succs[i] &&
+                !atomic_compare_exchange_strong(&new->next[i], &tmp,
+                                                (uintptr_t) succs[i])) {
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    list_node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+
+    if (!__list_find(list, &key, preds, succs)) {
+        return false;
+    }
+
+    list_node_t *node = succs[0];
+
+    for (int i = node->level - 1; i > 0; i--) {
+        uintptr_t next = atomic_load(&node->next[i]);
+        while (!is_marked(next)) {
+            atomic_compare_exchange_strong(&node->next[i], &next,
+                                           get_marked(next));
+        }
+    }
+
+    uintptr_t next = atomic_load(&node->next[0]);
+    while (true) {
+        if (is_marked(next)) {
+            return false;
+        }
+        if (atomic_compare_exchange_strong(&node->next[0], &next,
+                                           get_marked(next))) {
+            break;
+        }
+    }
+
+    __list_find(list, &key, preds, succs);
+    atomic_fetch_add(&deleted, 1);
+    return true;
+}
+
+#ifndef LIST_BENCH
+
+#define N_ELEMENTS 1024
+#define N_THREADS 4
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    list_t *list = arg;
+
+    // Slight changes to test ordering
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        list_insert(list, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    list_t *list = arg;
+
+    int deleted = 0;
+    for (int j = 0; j < 1000000; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i += 2)
+            deleted += list_delete(list, (uintptr_t) &elements[tid()-1][i]);
+        if (deleted == N_ELEMENTS / 2) {
+            printf("\t\t break at %d\n", j);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    for (size_t tid = 0; tid < tid_v_base; tid += 2) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i]) != (i & 1)) {
+                fprintf(stderr, "KEY %lu %s!\n", (uintptr_t) &elements[tid][i],
+                        (i & 1) ? "NOT FOUND" : "FOUND AFTER DELETE");
+                return -1;
+            }
+        }
+    }
+
+    list_node_t *head = (list_node_t *) atomic_load(&list->head);
+    for (int level = 0; level < MAX_LEVEL; level++) {
+        list_node_t *cur = head;
+        while (cur->key != UINTPTR_MAX) {
+            list_node_t *next = (list_node_t *) atomic_load(&cur->next[level]);
+            if (level == 0 && is_marked(next)) {
+                fprintf(stderr, "MARKED NODE %lu LEFT ON LEVEL %d!\n",
+                        cur->key, level);
+                return -1;
+            }
+            next = get_unmarked_node(next);
+            if (!(cur->key < next->key)) {
+                fprintf(stderr, "UNEXPECTED ORDERING ON LEVEL %d, "
+                        "%lu BEFORE %lu\n", level, cur->key, next->key);
+                return -1;
+            }
+            cur = next;
+        }
+    }
+
+    printf("insert %d delete %ld\n", (N_THREADS >> 1) * N_ELEMENTS, deleted);
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
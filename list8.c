@@ -0,0 +1,378 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <threads.h>
+
+#include "search.h"
+
+#define TID_UNKNOWN -1
+#define MAX_THREADS 128
+
+/*
+ * Unrolled list: every node holds up to NODE_KEYS sorted keys, all in
+ * [lo, next->lo). A node's lo never changes, so a traversal only follows
+ * next pointers and compares lo, one node per NODE_KEYS keys.
+ *
+ * Writers lock the one node a key belongs in. A full node is split by moving
+ * its upper half into a new node linked after it, and a node that falls below
+ * MERGE_BELOW keys is merged into its predecessor, locked left to right,
+ * when both fit in one node; the merged node is marked and never freed.
+ * Readers take no locks: every node has a version that writers make odd
+ * while they change it, and a reader retries whenever the version it saw
+ * before reading the node's keys has changed after. Keys are found within a
+ * node with search.h's vector compares where the CPU has them.
+ */
+#ifndef NODE_KEYS
+#define NODE_KEYS   16
+#endif
+#define MERGE_BELOW (NODE_KEYS / 4)
+
+typedef struct {
+    atomic_uintptr_t    next;
+    uintptr_t           lo;
+    atomic_uint         version;
+    atomic_int          count;
+    atomic_bool         marked;
+    pthread_mutex_t     lock;
+    atomic_uintptr_t    keys[NODE_KEYS];
+} list_node_t;
+
+typedef struct {
+    list_node_t         *head;
+    list_node_t         *tail;
+} list_t;
+
+static list_node_t *node_new(uintptr_t lo)
+{
+    list_node_t *node = malloc(sizeof(list_node_t));
+    node->lo = lo;
+    atomic_init(&node->version, 0);
+    atomic_init(&node->count, 0);
+    atomic_init(&node->marked, false);
+    pthread_mutex_init(&node->lock, NULL);
+    return node;
+}
+
+static list_t *list_new() {
+    list_t *list = malloc(sizeof(list_t));
+    list_node_t *sentry_head = node_new(0);
+    list_node_t *sentry_tail = node_new(UINTPTR_MAX);
+    atomic_init(&sentry_head->next, (uintptr_t) sentry_tail);
+    atomic_init(&sentry_tail->next, 0);
+
+    list->head = sentry_head;
+    list->tail = sentry_tail;
+
+    return list;
+}
+
+static inline void node_write_begin(list_node_t *node)
+{
+    atomic_fetch_add(&node->version, 1);
+}
+
+static inline void node_write_end(list_node_t *node)
+{
+    atomic_fetch_add(&node->version, 1);
+}
+
+/*
+ * The last node from `from` on whose lo is not above key
+ */
+static list_node_t *__list_locate(list_node_t *from, uintptr_t key)
+{
+    list_node_t *curr = from;
+
+    while (true) {
+        list_node_t *next = (list_node_t *) atomic_load(&curr->next);
+        if (next->lo > key)
+            return curr;
+        curr = next;
+    }
+}
+
+/*
+ * Returns the node key belongs in, locked and validated: not merged away,
+ * and not split since it was located
+ */
+static list_node_t *__list_lock(list_t *list, uintptr_t key)
+{
+    while (true) {
+        list_node_t *node = __list_locate(list->head, key);
+
+        pthread_mutex_lock(&node->lock);
+        if (!atomic_load(&node->marked) &&
+            ((list_node_t *) atomic_load(&node->next))->lo > key)
+            return node;
+        pthread_mutex_unlock(&node->lock);
+    }
+}
+
+static bool list_insert(list_t *list, uintptr_t key)
+{
+    list_node_t *node = __list_lock(list, key);
+    int count = atomic_load(&node->count);
+    int i = key_search(node->keys, count, key);
+
+    if (i < count && atomic_load(&node->keys[i]) == key) {
+        pthread_mutex_unlock(&node->lock);
+        return false;
+    }
+
+    bool placed = false;
+
+    node_write_begin(node);
+    if (count == NODE_KEYS) {
+        // Build the upper half completely before it is linked
+        int half = NODE_KEYS / 2;
+        list_node_t *new = node_new(atomic_load(&node->keys[half]));
+        for (int j = half; j < NODE_KEYS; j++)
+            atomic_init(&new->keys[j - half], atomic_load(&node->keys[j]));
+        atomic_init(&new->count, NODE_KEYS - half);
+        atomic_init(&new->next, atomic_load(&node->next));
+
+        count = half;
+        if (key >= new->lo) {
+            int k = key_search(new->keys, NODE_KEYS - half, key);
+            for (int j = NODE_KEYS - half; j > k; j--)
+                atomic_init(&new->keys[j], atomic_load(&new->keys[j - 1]));
+            atomic_init(&new->keys[k], key);
+            atomic_init(&new->count, NODE_KEYS - half + 1);
+            placed = true;
+        }
+        atomic_store(&node->next, (uintptr_t) new);
+        atomic_store(&node->count, count);
+    }
+    if (!placed) {
+        for (int j = count; j > i; j--)
+            atomic_store_explicit(&node->keys[j],
+                                  atomic_load(&node->keys[j - 1]),
+                                  memory_order_relaxed);
+        atomic_store_explicit(&node->keys[i], key, memory_order_relaxed);
+        atomic_store(&node->count, count + 1);
+    }
+    node_write_end(node);
+
+    pthread_mutex_unlock(&node->lock);
+    return true;
+}
+
+/*
+ * Best effort: merge node into its predecessor if both still fit in one
+ */
+static void __list_merge(list_t *list, list_node_t *node)
+{
+    list_node_t *pred = list->head, *next;
+
+    while ((next = (list_node_t *) atomic_load(&pred->next)) != node) {
+        if (next->lo >= node->lo)
+            return;
+        pred = next;
+    }
+
+    pthread_mutex_lock(&pred->lock);
+    pthread_mutex_lock(&node->lock);
+
+    int count = atomic_load(&pred->count), n = atomic_load(&node->count);
+    if (!atomic_load(&pred->marked) && !atomic_load(&node->marked) &&
+        (list_node_t *) atomic_load(&pred->next) == node &&
+        n < MERGE_BELOW && count + n <= NODE_KEYS) {
+        node_write_begin(pred);
+        node_write_begin(node);
+        for (int j = 0; j < n; j++)
+            atomic_store_explicit(&pred->keys[count + j],
+                                  atomic_load(&node->keys[j]),
+                                  memory_order_relaxed);
+        atomic_store(&pred->count, count + n);
+        atomic_store(&node->marked, true);
+        atomic_store(&pred->next, atomic_load(&node->next));
+        node_write_end(node);
+        node_write_end(pred);
+    }
+
+    pthread_mutex_unlock(&node->lock);
+    pthread_mutex_unlock(&pred->lock);
+}
+
+static bool list_delete(list_t *list, uintptr_t key)
+{
+    list_node_t *node = __list_lock(list, key);
+    int count = atomic_load(&node->count);
+    int i = key_search(node->keys, count, key);
+
+    if (i == count || atomic_load(&node->keys[i]) != key) {
+        pthread_mutex_unlock(&node->lock);
+        return false;
+    }
+
+    node_write_begin(node);
+    for (int j = i; j < count - 1; j++)
+        atomic_store_explicit(&node->keys[j], atomic_load(&node->keys[j + 1]),
+                              memory_order_relaxed);
+    atomic_store(&node->count, --count);
+    node_write_end(node);
+    pthread_mutex_unlock(&node->lock);
+
+    if (count < MERGE_BELOW && node != list->head)
+        __list_merge(list, node);
+    return true;
+}
+
+static bool list_find(list_t *list, uintptr_t key)
+{
+    list_node_t *node = list->head;
+
+    while (true) {
+        node = __list_locate(node, key);
+
+        unsigned version = atomic_load(&node->version);
+        if (version & 1) {
+            sched_yield();
+            continue;
+        }
+
+        int count = atomic_load(&node->count);
+        if (count > NODE_KEYS)
+            count = NODE_KEYS;
+        int i = key_search(node->keys, count, key);
+        bool found = i < count && atomic_load_explicit(&node->keys[i],
+                                             memory_order_relaxed) == key;
+        bool split = ((list_node_t *) atomic_load(&node->next))->lo <= key;
+        bool marked = atomic_load(&node->marked);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load(&node->version) != version || split)
+            continue;
+        if (marked) {
+            node = list->head;
+            continue;
+        }
+        return found;
+    }
+}
+
+static thread_local int tid_v = TID_UNKNOWN;
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+static inline int tid(void)
+{
+    if (tid_v == TID_UNKNOWN) {
+        tid_v = atomic_fetch_add(&tid_v_base, 1);
+    }
+    return tid_v;
+}
+
+#ifndef LIST_BENCH
+
+#define N_ELEMENTS 1024
+#define N_THREADS 8
+
+static uintptr_t elements[MAX_THREADS + 1][N_ELEMENTS];
+
+static void *insert_thread(void *arg)
+{
+    list_t *list = arg;
+
+    for (int i = N_ELEMENTS - 1; i >= 0; i--)
+        list_insert(list, (uintptr_t) &elements[tid()][i]);
+
+    return NULL;
+}
+
+static void *delete_thread(void *arg)
+{
+    list_t *list = arg;
+
+    // Keys may not be inserted yet, retry until all of them are gone
+    int deleted = 0;
+    for (int j = 0; j < 1000000 && deleted < N_ELEMENTS / 2; j++) {
+        for (size_t i = 0; i < N_ELEMENTS; i += 2)
+            deleted += list_delete(list, (uintptr_t) &elements[tid()-1][i]);
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void *test_thread(void *arg)
+{
+    // Pair every delete thread with the insert thread of the tid below it
+    return (tid() & 1) ? delete_thread(arg) : insert_thread(arg);
+}
+
+/*
+ * Every node in order, its keys sorted and within [lo, next->lo)
+ */
+static int list_check(list_t *list, size_t expect)
+{
+    size_t keys = 0, nodes = 0;
+
+    for (list_node_t *cur = list->head; cur != list->tail;
+         cur = (list_node_t *) cur->next) {
+        list_node_t *next = (list_node_t *) cur->next;
+        uintptr_t last = cur->lo;
+
+        if (cur->marked || !(cur->lo < next->lo) || cur->count > NODE_KEYS) {
+            fprintf(stderr, "BROKEN NODE %lu!\n", cur->lo);
+            return -1;
+        }
+        for (int i = 0; i < cur->count; i++) {
+            if ((i && cur->keys[i] <= last) || cur->keys[i] < last ||
+                cur->keys[i] >= next->lo) {
+                fprintf(stderr, "KEY %lu OUT OF PLACE IN NODE %lu!\n",
+                        cur->keys[i], cur->lo);
+                return -1;
+            }
+            last = cur->keys[i];
+        }
+        keys += cur->count;
+        nodes++;
+    }
+
+    if (keys != expect) {
+        fprintf(stderr, "EXPECTED %zu KEYS, COUNTED %zu\n", expect, keys);
+        return -1;
+    }
+    printf("%zu keys in %zu nodes\n", keys, nodes);
+    return 0;
+}
+
+int main() {
+    pthread_t thr[N_THREADS];
+
+    list_t *list = list_new();
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_create(&thr[i], NULL, test_thread, list);
+
+    for (size_t i = 0; i < N_THREADS; i++)
+        pthread_join(thr[i], NULL);
+
+    for (size_t tid = 0; tid < tid_v_base; tid += 2) {
+        for (size_t i = 0; i < N_ELEMENTS; i++) {
+            if (list_find(list, (uintptr_t) &elements[tid][i]) != (i & 1)) {
+                fprintf(stderr, "KEY %lu %s!\n", (uintptr_t) &elements[tid][i],
+                        (i & 1) ? "NOT FOUND" : "FOUND AFTER DELETE");
+                return -1;
+            }
+        }
+    }
+    if (list_check(list, (N_THREADS >> 1) * (N_ELEMENTS / 2)))
+        return -1;
+
+    // Empty it again, merging nodes on the way
+    for (size_t tid = 0; tid < tid_v_base; tid += 2)
+        for (size_t i = 1; i < N_ELEMENTS; i += 2)
+            list_delete(list, (uintptr_t) &elements[tid][i]);
+    if (list_check(list, 0))
+        return -1;
+
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
+
+#endif
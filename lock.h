@@ -0,0 +1,263 @@
+/*
+ * The list lock, picked at build time
+ *
+ *  default         pthread mutex
+ *  -DLOCK_TTAS     test-and-test-and-set spinlock
+ *  -DLOCK_TICKET   ticket lock: FIFO, everyone spins on the one owner field
+ *  -DLOCK_MCS      MCS queue lock: FIFO, each waiter spins on its own node,
+ *                  which its predecessor clears on release
+ *  -DLOCK_CLH      CLH queue lock: FIFO, each waiter spins on the node of its
+ *                  predecessor and takes that node over for its next turn
+ *
+ * Spinning waiters yield every LOCK_SPINS spins, as a preempted holder or
+ * successor would otherwise stall everyone until the end of their time
+ * slice whenever there are more threads than CPUs.
+ *
+ * An includer that defines LOCK_WAIT(ns) first gets the time every
+ * lock_acquire() of a thread with lock_timed set waited for the lock.
+ *
+ * The queue nodes are indexed by tid(), one more than MAX_THREADS for the
+ * tests' main thread, which looks up after MAX_THREADS workers, and a
+ * thread holds one lock at a time. The including file defines MAX_THREADS
+ * and tid() first.
+ */
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <sched.h>
+#include <time.h>
+
+#define LOCK_SPINS      128
+
+static inline void lock_spin(unsigned *spins)
+{
+    if (++*spins % LOCK_SPINS == 0) {
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#if defined(LOCK_TTAS)
+
+#define LOCK_NAME       "ttas"
+
+typedef struct {
+    atomic_bool         held;
+} lock_t;
+
+static void lock_init(lock_t *l)
+{
+    atomic_init(&l->held, false);
+}
+
+static inline void __lock_acquire(lock_t *l)
+{
+    unsigned spins = 0;
+
+    while (atomic_exchange_explicit(&l->held, true, memory_order_acquire))
+        while (atomic_load_explicit(&l->held, memory_order_relaxed))
+            lock_spin(&spins);
+}
+
+static inline void lock_release(lock_t *l)
+{
+    atomic_store_explicit(&l->held, false, memory_order_release);
+}
+
+#elif defined(LOCK_TICKET)
+
+#define LOCK_NAME       "ticket"
+
+typedef struct {
+    atomic_uint         next;
+    alignas(128) atomic_uint owner;
+} lock_t;
+
+static void lock_init(lock_t *l)
+{
+    atomic_init(&l->next, 0);
+    atomic_init(&l->owner, 0);
+}
+
+static inline void __lock_acquire(lock_t *l)
+{
+    unsigned ticket = atomic_fetch_add_explicit(&l->next, 1,
+                                                memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (atomic_load_explicit(&l->owner, memory_order_acquire) != ticket)
+        lock_spin(&spins);
+}
+
+static inline void lock_release(lock_t *l)
+{
+    unsigned owner = atomic_load_explicit(&l->owner, memory_order_relaxed);
+    atomic_store_explicit(&l->owner, owner + 1, memory_order_release);
+}
+
+#elif defined(LOCK_MCS)
+
+#define LOCK_NAME       "mcs"
+
+typedef struct mcs_node {
+    alignas(128) _Atomic(struct mcs_node *) next;
+    atomic_bool         locked;
+} mcs_node_t;
+
+typedef struct {
+    _Atomic(mcs_node_t *) tail;
+} lock_t;
+
+static mcs_node_t mcs_nodes[MAX_THREADS + 1];
+
+static void lock_init(lock_t *l)
+{
+    atomic_init(&l->tail, NULL);
+}
+
+static inline void __lock_acquire(lock_t *l)
+{
+    mcs_node_t *me = &mcs_nodes[tid()];
+    unsigned spins = 0;
+
+    atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&me->locked, true, memory_order_relaxed);
+
+    mcs_node_t *pred = atomic_exchange_explicit(&l->tail, me,
+                                                memory_order_acq_rel);
+    if (!pred)
+        return;
+
+    atomic_store_explicit(&pred->next, me, memory_order_release);
+    while (atomic_load_explicit(&me->locked, memory_order_acquire))
+        lock_spin(&spins);
+}
+
+static inline void lock_release(lock_t *l)
+{
+    mcs_node_t *me = &mcs_nodes[tid()];
+    mcs_node_t *next = atomic_load_explicit(&me->next, memory_order_acquire);
+    unsigned spins = 0;
+
+    if (!next) {
+        mcs_node_t *expected = me;
+        if (atomic_compare_exchange_strong_explicit(&l->tail, &expected, NULL,
+                                                    memory_order_release,
+                                                    memory_order_relaxed))
+            return;
+
+        // A successor swapped itself in and is about to link to us
+        while (!(next = atomic_load_explicit(&me->next,
+                                             memory_order_acquire)))
+            lock_spin(&spins);
+    }
+    atomic_store_explicit(&next->locked, false, memory_order_release);
+}
+
+#elif defined(LOCK_CLH)
+
+#define LOCK_NAME       "clh"
+
+typedef struct {
+    alignas(128) atomic_bool locked;
+} clh_node_t;
+
+typedef struct {
+    _Atomic(clh_node_t *) tail;
+    clh_node_t          dummy;
+} lock_t;
+
+// The node every thread enqueues next and the one it waited on, which it
+// takes over after release; nodes move between threads, so none is on a
+// thread's stack or in its thread-local storage
+static clh_node_t clh_nodes[MAX_THREADS + 1];
+static clh_node_t *clh_mine[MAX_THREADS + 1];
+static clh_node_t *clh_pred[MAX_THREADS + 1];
+
+static void lock_init(lock_t *l)
+{
+    atomic_init(&l->dummy.locked, false);
+    atomic_init(&l->tail, &l->dummy);
+}
+
+static inline void __lock_acquire(lock_t *l)
+{
+    int t = tid();
+    unsigned spins = 0;
+
+    if (!clh_mine[t])
+        clh_mine[t] = &clh_nodes[t];
+    clh_node_t *me = clh_mine[t];
+    atomic_store_explicit(&me->locked, true, memory_order_relaxed);
+
+    clh_node_t *pred = atomic_exchange_explicit(&l->tail, me,
+                                                memory_order_acq_rel);
+    while (atomic_load_explicit(&pred->locked, memory_order_acquire))
+        lock_spin(&spins);
+    clh_pred[t] = pred;
+}
+
+static inline void lock_release(lock_t *l)
+{
+    int t = tid();
+
+    atomic_store_explicit(&clh_mine[t]->locked, false, memory_order_release);
+    clh_mine[t] = clh_pred[t];
+}
+
+#else
+
+#define LOCK_NAME       "mutex"
+
+typedef struct {
+    pthread_mutex_t     mutex;
+} lock_t;
+
+static void lock_init(lock_t *l)
+{
+    pthread_mutex_init(&l->mutex, NULL);
+}
+
+static inline void __lock_acquire(lock_t *l)
+{
+    pthread_mutex_lock(&l->mutex);
+}
+
+static inline void lock_release(lock_t *l)
+{
+    pthread_mutex_unlock(&l->mutex);
+}
+
+#endif
+
+#ifdef LOCK_WAIT
+
+static thread_local bool lock_timed;
+
+static inline void lock_acquire(lock_t *l)
+{
+    struct timespec t0, t1;
+
+    if (!lock_timed) {
+        __lock_acquire(l);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    __lock_acquire(l);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    LOCK_WAIT((uint64_t) (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+              t1.tv_nsec - t0.tv_nsec);
+}
+
+#else
+
+#define lock_acquire(l) __lock_acquire(l)
+
+#endif
+
+#endif
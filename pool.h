@@ -0,0 +1,122 @@
+/*
+ * Per-thread node pool
+ *
+ * Every thread allocates list_node_t from its own slabs without any atomic
+ * operation. Slabs are handed out in batches by a global pool, and a slab
+ * stays owned by the thread that got it: a node freed by any other thread is
+ * pushed onto the owner's remote free stack, which the owner takes over in
+ * one exchange once its local free list runs dry.
+ *
+ * The including file defines list_node_t, MAX_THREADS and tid() first.
+ * Build with -DALLOC_MALLOC to fall back to malloc()/free().
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#ifdef ALLOC_MALLOC
+
+static inline list_node_t *node_alloc(void)
+{
+    return malloc(sizeof(list_node_t));
+}
+
+static inline void node_free(list_node_t *node)
+{
+    free(node);
+}
+
+#else
+
+#define POOL_SLAB_SIZE      (64 * 1024)
+#define POOL_SLAB_BATCH     16
+#define POOL_OBJ_SIZE       ((sizeof(list_node_t) + 15) & ~(size_t) 15)
+
+typedef struct pool_obj {
+    struct pool_obj     *next;
+} pool_obj_t;
+
+typedef struct {
+    int                 owner;
+} pool_slab_t;
+
+typedef struct {
+    alignas(128) pool_obj_t     *free;
+    char                        *bump;
+    char                        *end;
+    alignas(128) atomic_uintptr_t   remote;
+} pool_cache_t;
+
+static pool_cache_t pool_cache[MAX_THREADS];
+
+static struct {
+    pthread_mutex_t     lock;
+    char                *chunk;
+    size_t              left;
+} pool_global = { PTHREAD_MUTEX_INITIALIZER, NULL, 0 };
+
+static char *pool_slab_get(int owner)
+{
+    pthread_mutex_lock(&pool_global.lock);
+    if (!pool_global.left) {
+        pool_global.chunk = aligned_alloc(POOL_SLAB_SIZE,
+                                          POOL_SLAB_SIZE * POOL_SLAB_BATCH);
+        pool_global.left = POOL_SLAB_BATCH;
+    }
+    char *slab = pool_global.chunk;
+    pool_global.chunk += POOL_SLAB_SIZE;
+    pool_global.left--;
+    pthread_mutex_unlock(&pool_global.lock);
+
+    ((pool_slab_t *) slab)->owner = owner;
+    return slab;
+}
+
+static list_node_t *node_alloc(void)
+{
+    pool_cache_t *c = &pool_cache[tid()];
+    pool_obj_t *obj = c->free;
+
+    if (!obj) {
+        obj = (pool_obj_t *) atomic_exchange_explicit(&c->remote, 0,
+                                                      memory_order_acquire);
+    }
+    if (obj) {
+        c->free = obj->next;
+        return (list_node_t *) obj;
+    }
+
+    if ((size_t) (c->end - c->bump) < POOL_OBJ_SIZE) {
+        c->bump = pool_slab_get(tid());
+        c->end = c->bump + POOL_SLAB_SIZE;
+        c->bump += POOL_OBJ_SIZE;
+    }
+    obj = (pool_obj_t *) c->bump;
+    c->bump += POOL_OBJ_SIZE;
+    return (list_node_t *) obj;
+}
+
+static void node_free(list_node_t *node)
+{
+    pool_obj_t *obj = (pool_obj_t *) node;
+    pool_slab_t *slab = (pool_slab_t *)
+        ((uintptr_t) node & ~(uintptr_t) (POOL_SLAB_SIZE - 1));
+    pool_cache_t *c = &pool_cache[slab->owner];
+
+    if (slab->owner == tid()) {
+        obj->next = c->free;
+        c->free = obj;
+        return;
+    }
+
+    uintptr_t head = atomic_load_explicit(&c->remote, memory_order_relaxed);
+    do {
+        obj->next = (pool_obj_t *) head;
+    } while (!atomic_compare_exchange_weak_explicit(&c->remote, &head,
+                                                    (uintptr_t) obj,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Microbenchmark of search.h's in-node key search
+ *
+ * For node widths of 4 to 32 keys, times every search kernel the CPU runs,
+ * and the dispatched key_search(), over a node of sorted random keys and
+ * queries spread over its range, after checking that all of them agree
+ * with the scalar search.
+ *
+ *  ./search [-n searches per width and kernel]
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "search.h"
+
+#define MAX_WIDTH   32
+#define N_QUERIES   4096
+
+typedef struct {
+    const char          *name;
+    key_search_t        search;
+    bool                runs;
+} kernel_t;
+
+static kernel_t kernels[] = {
+    {"scalar", key_search_scalar, true},
+#ifdef KEY_SEARCH_SIMD
+    {"sse4.2", key_search_sse42, false},
+    {"avx2", key_search_avx2, false},
+#endif
+    {"dispatch", key_search, true},
+};
+
+#define N_KERNELS   (sizeof(kernels) / sizeof(kernels[0]))
+
+static atomic_uintptr_t keys[MAX_WIDTH];
+static uintptr_t queries[N_QUERIES];
+static volatile int sink;
+
+static inline uint64_t xorshift64(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+    long searches = 10000000;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt != 'n' || (searches = atol(optarg)) < N_QUERIES) {
+            fprintf(stderr, "usage: %s [-n searches, at least %d]\n", argv[0],
+                    N_QUERIES);
+            return 1;
+        }
+    }
+
+#ifdef KEY_SEARCH_SIMD
+    kernels[1].runs = __builtin_cpu_supports("sse4.2");
+    kernels[2].runs = __builtin_cpu_supports("avx2");
+#endif
+
+    printf("# %ld searches per width and kernel\n", searches);
+    printf("%5s", "width");
+    for (size_t k = 0; k < N_KERNELS; k++)
+        printf(" %9s", kernels[k].name);
+    printf("   ns/search\n");
+
+    for (int width = 4; width <= MAX_WIDTH; width *= 2) {
+        // Keys spread over the top half too, where signed compares go wrong
+        uintptr_t key = 0;
+        for (int i = 0; i < width; i++) {
+            key += xorshift64(&seed) >> 5;
+            atomic_init(&keys[i], key);
+        }
+        for (int q = 0; q < N_QUERIES; q++) {
+            uintptr_t hit = atomic_load(&keys[xorshift64(&seed) % width]);
+            queries[q] = (q & 1) ? hit : hit + xorshift64(&seed) % 3 - 1;
+        }
+
+        for (size_t k = 0; k < N_KERNELS; k++) {
+            if (!kernels[k].runs)
+                continue;
+            for (int q = 0; q < N_QUERIES; q++) {
+                int want = key_search_scalar(keys, width, queries[q]);
+                int got = kernels[k].search(keys, width, queries[q]);
+                if (got != want) {
+                    fprintf(stderr, "%s: KEY %" PRIxPTR " AT %d, NOT %d!\n",
+                            kernels[k].name, queries[q], got, want);
+                    return -1;
+                }
+            }
+        }
+
+        printf("%5d", width);
+        for (size_t k = 0; k < N_KERNELS; k++) {
+            if (!kernels[k].runs) {
+                printf(" %9s", "-");
+                continue;
+            }
+            key_search_t search = kernels[k].search;
+            int sum = 0;
+            double start = now();
+            for (long n = 0; n < searches; n++)
+                sum += search(keys, width, queries[n % N_QUERIES]);
+            sink = sum;
+            printf(" %9.2f", (now() - start) * 1e9 / searches);
+        }
+        printf("\n");
+    }
+
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Search of a node's sorted key array
+ *
+ * key_search(keys, count, key) returns the index of the first of count
+ * sorted keys not below key. On x86-64 it compares 4 keys at a time with
+ * AVX2, or 2 with SSE4.2, picked once at startup by what the CPU supports;
+ * elsewhere, with -DKEY_SEARCH_SCALAR, or under TSan, it steps one key at a
+ * time. The vector loads are plain loads of keys writers may be changing, so
+ * callers only trust the result once their node version check passes; TSan
+ * cannot know that and gets the scalar search with its atomic loads.
+ */
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if defined(__SANITIZE_THREAD__)
+#define KEY_SEARCH_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define KEY_SEARCH_TSAN
+#endif
+#endif
+
+#if defined(__x86_64__) && !defined(KEY_SEARCH_SCALAR) && \
+    !defined(KEY_SEARCH_TSAN)
+#define KEY_SEARCH_SIMD
+#include <immintrin.h>
+#endif
+
+typedef int (*key_search_t)(const atomic_uintptr_t *keys, int count,
+                            uintptr_t key);
+
+static inline int key_search_scalar(const atomic_uintptr_t *keys, int count,
+                                    uintptr_t key)
+{
+    int i = 0;
+    while (i < count && atomic_load_explicit(&keys[i],
+                                             memory_order_relaxed) < key)
+        i++;
+    return i;
+}
+
+#ifdef KEY_SEARCH_SIMD
+
+// The compares are signed, flipping the top bit orders keys as unsigned
+#define KEY_BIAS    LLONG_MIN
+
+__attribute__((target("sse4.2")))
+static inline int key_search_sse42(const atomic_uintptr_t *keys, int count,
+                                   uintptr_t key)
+{
+    const uintptr_t *k = (const uintptr_t *) keys;
+    __m128i bias = _mm_set1_epi64x(KEY_BIAS);
+    __m128i x = _mm_set1_epi64x((long long) key ^ KEY_BIAS);
+    int i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *) &k[i]),
+                                  bias);
+        int below = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(x, v)));
+        if (below != 0x3)
+            return i + __builtin_popcount(below);
+    }
+    return i + key_search_scalar(&keys[i], count - i, key);
+}
+
+__attribute__((target("avx2")))
+static inline int key_search_avx2(const atomic_uintptr_t *keys, int count,
+                                  uintptr_t key)
+{
+    const uintptr_t *k = (const uintptr_t *) keys;
+    __m256i bias = _mm256_set1_epi64x(KEY_BIAS);
+    __m256i x = _mm256_set1_epi64x((long long) key ^ KEY_BIAS);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *) &k[i]), bias);
+        int below = _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(x, v)));
+        if (below != 0xf)
+            return i + __builtin_popcount(below);
+    }
+    return i + key_search_scalar(&keys[i], count - i, key);
+}
+
+static key_search_t key_search_impl = key_search_scalar;
+
+__attribute__((constructor))
+static void key_search_init(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        key_search_impl = key_search_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        key_search_impl = key_search_sse42;
+}
+
+static inline int key_search(const atomic_uintptr_t *keys, int count,
+                             uintptr_t key)
+{
+    return key_search_impl(keys, count, key);
+}
+
+#else
+
+static inline int key_search(const atomic_uintptr_t *keys, int count,
+                             uintptr_t key)
+{
+    return key_search_scalar(keys, count, key);
+}
+
+#endif
+
+#endif
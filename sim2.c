@@ -0,0 +1,466 @@
+/*
+ * Deterministic interleaving explorer for list5
+ *
+ * list5.c is compiled in unchanged, except that every atomic load, store and
+ * CAS first yields to a scheduler. Each simulated thread runs as a coroutine
+ * on one OS thread, and a step of the schedule lets one thread perform its
+ * next shared access, so a run is fully determined by its sequence of
+ * choices and can be replayed from scratch.
+ *
+ * The explorer either enumerates, depth first, every schedule that preempts
+ * a thread which could have continued at most -p times, or samples -r random
+ * schedules. The history of every run is checked for linearizability against
+ * a sequential set. A scenario is a set of initial keys (-i) and one program
+ * per thread (-t, repeated), e.g. -i 1,2,3 -t "d2" -t "d3 f2" for sim1's
+ * consecutive deletes; keys must be in [1, 63]. Without -t the built-in
+ * scenarios are run.
+ *
+ *  ./sim2 [-i key,key...] [-t "{i|d|f}key ..."]... [-p preemptions]
+ *         [-r runs] [-S seed]
+ */
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <threads.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+static void sim_yield(void);
+static void *sim_alloc(size_t align, size_t size);
+
+#undef atomic_load
+#undef atomic_store
+#undef atomic_compare_exchange_strong
+
+#define atomic_load(p)                                                  \
+    (sim_yield(), atomic_load_explicit(p, memory_order_seq_cst))
+#define atomic_store(p, v)                                              \
+    (sim_yield(), atomic_store_explicit(p, v, memory_order_seq_cst))
+#define atomic_compare_exchange_strong(p, e, d)                         \
+    (sim_yield(), atomic_compare_exchange_strong_explicit(              \
+        p, e, d, memory_order_seq_cst, memory_order_seq_cst))
+
+// Nodes come from an arena that every run starts over
+#define aligned_alloc(align, size)  sim_alloc(align, size)
+#define malloc(size)                sim_alloc(16, size)
+#define free(p)                     ((void) (p))
+
+#define LIST_BENCH
+#include "list5.c"
+
+#undef aligned_alloc
+#undef malloc
+#undef free
+
+#define SIM_THREADS     4
+#define SIM_OPS         8
+#define SIM_STACK       (64 * 1024)
+#define SIM_HEAP        (64 * 1024)
+#define SIM_DEPTH       4096
+#define SIM_MAX_KEY     63
+
+typedef struct {
+    char                kind;       // 'i', 'd' or 'f'
+    uintptr_t           key;
+    bool                result;
+    unsigned            inv, resp;
+} sim_op_t;
+
+typedef struct {
+    ucontext_t          ctx;
+    char                stack[SIM_STACK];
+    sim_op_t            ops[SIM_OPS];
+    int                 n_ops;
+    bool                done;
+} sim_thread_t;
+
+/*
+ * One scheduling decision: who could run, who did, and what is left to try
+ */
+typedef struct {
+    unsigned            enabled;
+    unsigned            tried;
+    int                 chosen;
+    int                 prev;
+    int                 preemptions;
+} sim_choice_t;
+
+static struct {
+    uintptr_t           init[SIM_MAX_KEY];
+    int                 n_init;
+    int                 n_threads;
+    int                 bound;
+} sc;
+
+static sim_thread_t thr[SIM_THREADS];
+static ucontext_t sched_ctx;
+static int sim_cur = -1;
+static unsigned sim_clock;
+static list_t *list;
+
+static sim_choice_t path[SIM_DEPTH];
+static int path_len, prefix_len;
+static bool sampling;
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+static alignas(128) char sim_heap[SIM_HEAP];
+static size_t sim_heap_used;
+
+static void *sim_alloc(size_t align, size_t size)
+{
+    sim_heap_used = (sim_heap_used + align - 1) & ~(align - 1);
+    if (sim_heap_used + size > SIM_HEAP) {
+        fprintf(stderr, "SIMULATED HEAP EXHAUSTED\n");
+        exit(-1);
+    }
+    void *p = &sim_heap[sim_heap_used];
+    sim_heap_used += size;
+    return p;
+}
+
+/*
+ * Called before every shared access: hand control back to the scheduler,
+ * which resumes this thread when it is picked to perform the access
+ */
+static void sim_yield(void)
+{
+    if (sim_cur < 0)
+        return;
+    swapcontext(&thr[sim_cur].ctx, &sched_ctx);
+}
+
+static void sim_resume(int t)
+{
+    sim_cur = t;
+    swapcontext(&sched_ctx, &thr[t].ctx);
+    sim_cur = -1;
+}
+
+static void sim_thread(int t)
+{
+    for (int i = 0; i < thr[t].n_ops; i++) {
+        sim_op_t *op = &thr[t].ops[i];
+
+        op->inv = sim_clock;
+        switch (op->kind) {
+        case 'i':
+            op->result = list_insert(list, op->key);
+            break;
+        case 'd':
+            op->result = list_delete(list, op->key);
+            break;
+        default:
+            op->result = list_find(list, op->key);
+        }
+        op->resp = sim_clock;
+    }
+    thr[t].done = true;
+}
+
+static inline uint64_t xorshift64(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static inline bool preempts(sim_choice_t *c, int t)
+{
+    return c->prev >= 0 && (c->enabled & (1u << c->prev)) && t != c->prev;
+}
+
+/*
+ * Past the replayed prefix: keep running the current thread when possible,
+ * so that a schedule spends its preemptions only where it was told to
+ */
+static int sim_pick(sim_choice_t *c)
+{
+    if (sampling) {
+        int n = __builtin_popcount(c->enabled);
+        int k = xorshift64(&seed) % n;
+        for (int t = 0; t < sc.n_threads; t++)
+            if ((c->enabled & (1u << t)) && !k--)
+                return t;
+    }
+    if (c->prev >= 0 && (c->enabled & (1u << c->prev)))
+        return c->prev;
+    return __builtin_ctz(c->enabled);
+}
+
+/*
+ * Replay path[0, prefix_len) and extend it to a complete run
+ */
+static void sim_run(void)
+{
+    int prev = -1, preemptions = 0;
+
+    sim_heap_used = 0;
+    sim_clock = 0;
+    list = list_new();
+    for (int i = 0; i < sc.n_init; i++)
+        list_insert(list, sc.init[i]);
+
+    for (int t = 0; t < sc.n_threads; t++) {
+        getcontext(&thr[t].ctx);
+        thr[t].ctx.uc_stack.ss_sp = thr[t].stack;
+        thr[t].ctx.uc_stack.ss_size = SIM_STACK;
+        thr[t].ctx.uc_link = &sched_ctx;
+        makecontext(&thr[t].ctx, (void (*)(void)) sim_thread, 1, t);
+        thr[t].done = false;
+
+        // Up to the first shared access, which is the first step
+        sim_resume(t);
+    }
+
+    for (path_len = 0; ; path_len++) {
+        unsigned enabled = 0;
+        for (int t = 0; t < sc.n_threads; t++)
+            enabled |= !thr[t].done << t;
+        if (!enabled)
+            break;
+        if (path_len == SIM_DEPTH) {
+            fprintf(stderr, "SCHEDULE LONGER THAN %d STEPS\n", SIM_DEPTH);
+            exit(-1);
+        }
+
+        sim_choice_t *c = &path[path_len];
+        if (path_len >= prefix_len) {
+            c->enabled = enabled;
+            c->prev = prev;
+            c->preemptions = preemptions;
+            c->chosen = sim_pick(c);
+            c->tried = 1u << c->chosen;
+        }
+
+        preemptions += preempts(c, c->chosen);
+        prev = c->chosen;
+        sim_clock++;
+        sim_resume(c->chosen);
+    }
+}
+
+/*
+ * Set up the next schedule to explore: the latest choice that has an
+ * untried alternative within the preemption bound takes it
+ */
+static bool sim_next(void)
+{
+    while (path_len > 0) {
+        sim_choice_t *c = &path[--path_len];
+
+        for (int t = 0; t < sc.n_threads; t++) {
+            if (!(c->enabled & ~c->tried & (1u << t)))
+                continue;
+            c->tried |= 1u << t;
+            if (c->preemptions + preempts(c, t) > sc.bound)
+                continue;
+            c->chosen = t;
+            prefix_len = path_len + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Wing & Gong: try every operation that no pending one must precede as the
+ * next linearization point, and backtrack when its result does not match
+ */
+static bool lin_check(sim_op_t **ops, int n, unsigned done, uint64_t set)
+{
+    if (done == (1u << n) - 1)
+        return true;
+
+    for (int i = 0; i < n; i++) {
+        if (done & (1u << i))
+            continue;
+
+        bool minimal = true;
+        for (int j = 0; j < n && minimal; j++)
+            minimal = j == i || (done & (1u << j)) ||
+                      ops[j]->resp > ops[i]->inv;
+        if (!minimal)
+            continue;
+
+        uint64_t bit = 1ULL << ops[i]->key, next = set;
+        bool expect = set & bit;
+        if (ops[i]->kind == 'i') {
+            expect = !expect;
+            next |= bit;
+        } else if (ops[i]->kind == 'd') {
+            next &= ~bit;
+        }
+        if (ops[i]->result == expect &&
+            lin_check(ops, n, done | (1u << i), next))
+            return true;
+    }
+    return false;
+}
+
+static bool sim_check(void)
+{
+    sim_op_t *ops[SIM_THREADS * SIM_OPS];
+    uint64_t set = 0;
+    int n = 0;
+
+    for (int i = 0; i < sc.n_init; i++)
+        set |= 1ULL << sc.init[i];
+    for (int t = 0; t < sc.n_threads; t++)
+        for (int i = 0; i < thr[t].n_ops; i++)
+            ops[n++] = &thr[t].ops[i];
+
+    return lin_check(ops, n, 0, set);
+}
+
+static void sim_report(void)
+{
+    fflush(stdout);
+    fprintf(stderr, "NOT LINEARIZABLE, schedule:");
+    for (int i = 0; i < path_len; i++)
+        fprintf(stderr, " %d", path[i].chosen);
+    fputc('\n', stderr);
+
+    for (int t = 0; t < sc.n_threads; t++)
+        for (int i = 0; i < thr[t].n_ops; i++)
+            fprintf(stderr, "  t%d %c%" PRIuPTR " -> %d  [%u, %u]\n", t,
+                    thr[t].ops[i].kind, thr[t].ops[i].key,
+                    thr[t].ops[i].result, thr[t].ops[i].inv,
+                    thr[t].ops[i].resp);
+}
+
+static int sim_explore(unsigned long runs)
+{
+    unsigned long n = 0;
+    int max_len = 0;
+
+    prefix_len = 0;
+    do {
+        sim_run();
+        if (path_len > max_len)
+            max_len = path_len;
+        if (!sim_check()) {
+            sim_report();
+            return -1;
+        }
+        if (sampling)
+            prefix_len = 0;
+    } while (++n != runs && (sampling || sim_next()));
+
+    printf("%lu schedules, up to %d steps: OK\n", n, max_len);
+    return 0;
+}
+
+static int parse_init(char *s)
+{
+    sc.n_init = 0;
+    for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        uintptr_t key = strtoul(tok, NULL, 0);
+        if (key < 1 || key > SIM_MAX_KEY)
+            return -1;
+        sc.init[sc.n_init++] = key;
+    }
+    return 0;
+}
+
+static int parse_thread(char *s)
+{
+    if (sc.n_threads == SIM_THREADS)
+        return -1;
+
+    sim_thread_t *t = &thr[sc.n_threads++];
+    t->n_ops = 0;
+    for (char *tok = strtok(s, " "); tok; tok = strtok(NULL, " ")) {
+        if (t->n_ops == SIM_OPS || !strchr("idf", tok[0]))
+            return -1;
+        sim_op_t *op = &t->ops[t->n_ops++];
+        op->kind = tok[0];
+        op->key = strtoul(tok + 1, NULL, 0);
+        if (op->key < 1 || op->key > SIM_MAX_KEY)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * sim1's two delete cases, then inserts and finds racing with deletes
+ */
+static const char *builtin[][SIM_THREADS + 1] = {
+    { "1,2,3,4,5", "d2", "d4" },
+    { "1,2,3,4,5", "d2", "d3" },
+    { "1,2,3", "d2", "d2 f2" },
+    { "1", "i2", "d2", "f2" },
+    { "2,4", "d2 i2", "i3 d4" },
+    { "1,3", "i2 d2", "d3 i3", "f2 f3" },
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-i key,key...] [-t \"{i|d|f}key ...\"]... "
+            "[-p preemptions] [-r runs] [-S seed]\n", prog);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long runs = 0;
+    int c;
+
+    sc.bound = 2;
+    while ((c = getopt(argc, argv, "i:t:p:r:S:h")) != -1) {
+        switch (c) {
+        case 'i':
+            if (parse_init(optarg))
+                usage(argv[0]);
+            break;
+        case 't':
+            if (parse_thread(optarg))
+                usage(argv[0]);
+            break;
+        case 'p':
+            sc.bound = atoi(optarg);
+            break;
+        case 'r':
+            runs = strtoul(optarg, NULL, 0);
+            if (!runs)
+                usage(argv[0]);
+            sampling = true;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (sc.n_threads)
+        return sim_explore(runs);
+
+    for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+        char buf[64];
+
+        strcpy(buf, builtin[i][0]);
+        parse_init(buf);
+        sc.n_threads = 0;
+        printf("init %-10s", builtin[i][0]);
+        for (int t = 1; t <= SIM_THREADS && builtin[i][t]; t++) {
+            strcpy(buf, builtin[i][t]);
+            parse_thread(buf);
+            printf(" | %-6s", builtin[i][t]);
+        }
+        printf(": ");
+        if (sim_explore(runs))
+            return -1;
+    }
+
+    fprintf(stderr, "TEST OK!\n");
+    return 0;
+}
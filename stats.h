@@ -0,0 +1,82 @@
+/*
+ * Per-thread operation statistics
+ *
+ * Every thread counts into its own cache line of list_stat, indexed by tid().
+ * A counter has one writer, so it is bumped with a relaxed load and store
+ * rather than an atomic add; list_stats() sums all threads on demand, also
+ * while they run. Build with -DLIST_NO_STATS to compile the counting out
+ * entirely.
+ *
+ * The including file defines MAX_THREADS and tid() first.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+typedef struct {
+    alignas(128) atomic_ulong   ops;        // list_* calls, batch keys
+    atomic_ulong                inserts;    // keys inserted
+    atomic_ulong                deletes;    // keys deleted
+    atomic_ulong                cas;        // CAS attempts
+    atomic_ulong                cas_failed;
+    atomic_ulong                restarts;   // searches started over
+    atomic_ulong                visits;     // nodes stepped over
+    atomic_ulong                unlinks;    // marked nodes unlinked by search
+    atomic_ulong                eliminated; // inserts and deletes paired off
+} list_stat_t;
+
+#ifndef LIST_NO_STATS
+
+#define LIST_STATS
+
+static list_stat_t list_stat[MAX_THREADS];
+
+static inline void stat_count(atomic_ulong *c, unsigned long n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+#define stat_add(field, n)  stat_count(&list_stat[tid()].field, (n))
+
+#else
+
+#define stat_add(field, n)  ((void) (n))
+
+#endif
+
+#define stat_inc(field)     stat_add(field, 1)
+
+static inline bool stat_cas(bool ok)
+{
+    stat_inc(cas);
+    stat_add(cas_failed, !ok);
+    return ok;
+}
+
+/*
+ * Sum of all threads' counters; while threads run, each counter is read
+ * once at some point during the call
+ */
+static void list_stats(list_stat_t *sum)
+{
+    memset(sum, 0, sizeof(*sum));
+#ifdef LIST_STATS
+#define stat_sum(field) \
+    stat_count(&sum->field, atomic_load_explicit(&list_stat[i].field, \
+                                                 memory_order_relaxed))
+
+    for (int i = 0; i < MAX_THREADS; i++) {
+        stat_sum(ops);
+        stat_sum(inserts);
+        stat_sum(deletes);
+        stat_sum(cas);
+        stat_sum(cas_failed);
+        stat_sum(restarts);
+        stat_sum(visits);
+        stat_sum(unlinks);
+        stat_sum(eliminated);
+    }
+#endif
+}
+
+#endif